@@ -0,0 +1,98 @@
+//This header file contains the two ways the extraction kernels find the position of a grid point:
+//RectilinearSpacing looks it up in the X, Y and Z coordinate arrays of the grid, and UniformSpacing
+//computes it as origin + i*h. The kernels are templated on the spacing, so when a grid turns out to be
+//evenly spaced the coordinate lookups compile down to a multiply-add.
+#ifndef GRIDSPACING_H
+#define GRIDSPACING_H
+
+#include <math.h>
+
+#include <vector>
+
+#include <vtkDataArray.h>
+#include <vtkRectilinearGrid.h>
+
+
+// ****************************************************************************
+//  Class: RectilinearSpacing
+//
+//  Purpose:
+//      The coordinates of a rectilinear grid, converted to float whatever
+//      type the grid stores them as.
+//
+// ****************************************************************************
+
+class RectilinearSpacing
+{
+   public:
+                   RectilinearSpacing(vtkRectilinearGrid *rgrid)
+     {
+         vtkDataArray *arrays[3] = { rgrid->GetXCoordinates(), rgrid->GetYCoordinates(),
+                                     rgrid->GetZCoordinates() };
+         for (int axis = 0 ; axis < 3 ; axis++)
+         {
+             coords[axis].resize(arrays[axis]->GetNumberOfTuples());
+             for (size_t i = 0 ; i < coords[axis].size() ; i++)
+                 coords[axis][i] = (float) arrays[axis]->GetComponent(i, 0);
+         }
+     };
+
+     inline float         X(int i) const { return coords[0][i]; };
+     inline float         Y(int i) const { return coords[1][i]; };
+     inline float         Z(int i) const { return coords[2][i]; };
+     inline float         Coord(int axis, int i) const { return coords[axis][i]; };
+
+     // True if the coordinates along every axis are evenly spaced, to within
+     // the precision they are usually written out with.
+     inline bool          IsUniform(void) const
+     {
+         for (int axis = 0 ; axis < 3 ; axis++)
+         {
+             int n = (int) coords[axis].size();
+             if (n < 2)
+                 continue;
+             float h = (coords[axis][n-1] - coords[axis][0]) / (n-1);
+             for (int i = 0 ; i < n ; i++)
+                 if (fabs(coords[axis][i] - (coords[axis][0] + i*h)) > 1e-4*fabs(h))
+                     return false;
+         }
+         return true;
+     };
+
+   protected:
+     std::vector<float>   coords[3];
+};
+
+
+// ****************************************************************************
+//  Class: UniformSpacing
+//
+//  Purpose:
+//      Evenly spaced coordinates, from the first and last coordinate of each
+//      axis of a grid for which RectilinearSpacing::IsUniform() is true.
+//
+// ****************************************************************************
+
+class UniformSpacing
+{
+   public:
+                   UniformSpacing(const RectilinearSpacing &rect, const int *dims)
+     {
+         for (int axis = 0 ; axis < 3 ; axis++)
+         {
+             origin[axis] = rect.Coord(axis, 0);
+             h[axis] = (dims[axis] > 1 ? (rect.Coord(axis, dims[axis]-1) - origin[axis]) / (dims[axis]-1) : 0.f);
+         }
+     };
+
+     inline float         X(int i) const { return origin[0] + i*h[0]; };
+     inline float         Y(int i) const { return origin[1] + i*h[1]; };
+     inline float         Z(int i) const { return origin[2] + i*h[2]; };
+     inline float         Coord(int axis, int i) const { return origin[axis] + i*h[axis]; };
+
+   protected:
+     float         origin[3];
+     float         h[3];
+};
+
+#endif
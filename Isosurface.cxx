@@ -22,6 +22,8 @@
 #include "vtkJPEGReader.h"
 #include "vtkImageData.h"
 #include <vtkPNGWriter.h>
+#include <vtkErrorCode.h>
+#include <vtkWindowToImageFilter.h>
 
 #include <vtkPolyData.h>
 #include <vtkPointData.h>
@@ -44,6 +46,27 @@
 #include <vtkSmartPointer.h>
 
 #include "TriangleList.h"
+#include "TriCase.h"
+#include "GridSpacing.h"
+#include "MeshCodec.h"
+#include "SurfaceCache.h"
+#include "IsosurfaceServer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <new>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
 
 
 // ****************************************************************************
@@ -191,304 +214,75 @@ void GetLogicalCellIndex(int *idx, int cellId, const int *dims)
 }
 
 
-int main()
+// ****************************************************************************
+//  Function: GetGradient
+//
+//  Arguments:
+//      idx:  the logical index of a point.
+//      dims: an array of size 3 with the number of points in X, Y, and Z.
+//      S:    the coordinates of the mesh (see GridSpacing.h)
+//      F:    the field values at the points
+//      g (output): the gradient of F at the point
+//
+//  Returns:  None (argument g is output)
+//
+//  Notes:    Central differences are used in the interior and one-sided
+//            differences on the boundary of the mesh.
+//
+// ****************************************************************************
+
+template <class T, class Spacing>
+void GetGradient(const int *idx, const int *dims, const Spacing &S, const T *F, float *g)
 {
-	int i, j;
-    //***********************************************************************************************
-    /*
-    The triCase is a crowdsourced (by the students in the class) array contains a case for every possible
-    combination of up to 5 triangles drawn in a 3-dimensional space. Each case represents an array of ints
-    that identify what edges of an imaginary cube the triangles are touching. Each student had multiple, assigned
-    cases to calculate edges for. My cases were the ones denoted by the "aphilli9" comments.
-    */
-    //**********************************************************************************************
-
-	static int triCase[256][16] = {
-		{ -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 0: aphilli9 */
-		{ 0, 3, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 1: chatfiel */
-		{ 0, 1, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 2: chesshir */
-		{ 1, 3, 8, 1, 8, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 3: cneugass */
-		{ 2, 3, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 4: cpalk */
-		{ 0, 8, 10, 0, 2, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 5: criegler */
-		{ 3, 10, 2, 0, 9, 1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 6: cworkman */
-		{ 1, 2, 10, 1, 9, 10, 8, 9, 10, -1, -1, -1, -1, -1, -1, -1 },  /* 7: ssane */
-		{ 1, 2, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 8: eewing */
-		{ 1, 2, 11, 0, 3, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 9: gmorriso */
-		{ 0, 2, 9, 2, 9, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 10: jbayes */
-		{ 8, 2, 3, 8, 2, 11, 8, 9, 11, -1, -1, -1, -1, -1, -1, -1 },  /*11: Areej Alghamdi (3) 0000 1011*/
-		{ 1, 3, 11, 3, 10, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 12: jhorn3 */
-		{ 0, 8, 10, 0, 1, 10, 1, 10, 11, -1, -1, -1, -1, -1, -1, -1 },  /* 13: jlowen */
-		{ 0, 3, 9, 3, 9, 10, 9, 10, 11, -1, -1, -1, -1, -1, -1, -1 },  /* 14: pem */
-		{ 8, 9, 11, 8, 10, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 15: kdawes */
-		{ 7, 8, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 16: kpinto */
-		{ 0, 3, 4, 3, 4, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 17: mcmillan */
-		{ 0, 1, 9, 4, 7, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 18: nivaldot */
-		{ 1, 3, 7, 1, 4, 7, 1, 4, 9, -1, -1, -1, -1, -1, -1, -1 },  /* 19: sgrady2 */
-		{ 7, 4, 8, 2, 3, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 20: touermi */
-		{ 0, 2, 4, 2, 4, 10, 4, 7, 10, -1, -1, -1, -1, -1, -1, -1 },  /* 21: tristanj */
-		{ 0, 1, 9, 2, 3, 10, 4, 7, 9, -1, -1, -1, -1, -1, -1, -1 },  /* 22: aphilli9 */
-		{ 1, 2, 9, 2, 9, 10, 4, 9, 10, 4, 7, 10, -1, -1, -1, -1 },  /* 23: chatfiel */
-		{ 1, 2, 11, 4, 7, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 24: chesshir */
-		{ 0, 3, 4, 0, 4, 7, 1, 2, 11, -1, -1, -1, -1, -1, -1, -1 },  /* 25: cneugass */
-		{ 0, 2, 9, 2, 9, 11, 4, 7, 8, -1, -1, -1, -1, -1, -1, -1 },  /* 26: cpalk */
-		{ 2, 3, 7, 2, 9, 11, 4, 7, 9, 2, 7, 9, -1, -1, -1, -1 },  /* 27: criegler */
-		{ 10, 3, 11, 4, 8, 10, 1, 11, 3, -1, -1, -1, -1, -1, -1, -1 },  /* 28: cworkman */
-		{ 7, 4, 10, 0, 1, 4, 1, 4, 10, 1, 10, 11, -1, -1, -1, -1 },  /*29: David Stevens (4) */
-		{ 4, 7, 8, 0, 3, 10, 0, 9, 10, 9, 10, 11, -1, -1, -1, -1 },  /* 30: eewing */
-		{ 9, 10, 11, 4, 9, 10, 4, 7, 10, -1, -1, -1, -1, -1, -1, -1 },  /* 31: gmorriso */
-		{ 4, 5, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 32: jbayes */
-		{ 0, 3, 8, 4, 5, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 33: jbrawner */
-		{ 0, 1, 5, 0, 4, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 34: jhorn3 */
-		{ 1, 3, 5, 3, 5, 8, 4, 5, 8, -1, -1, -1, -1, -1, -1, -1 },  /* 35: pem */
-		{ 2, 3, 10, 4, 5, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 36: jnelson */
-		{ 0, 2, 10, 0, 8, 10, 4, 5, 9, -1, -1, -1, -1, -1, -1, -1 },  /* 37: kdawes */
-		{ 5, 4, 0, 2, 10, 3, 1, 5, 0, -1, -1, -1, -1, -1, -1, -1 },  /* 38: kpinto */
-		{ 1, 2, 5, 2, 5, 10, 5, 10, 4, 10, 4, 8, -1, -1, -1, -1 },  /* 39: mcmillan */
-		{ 1, 2, 10, 4, 5, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 40: nivaldot */
-		{ 0, 3, 8, 1, 2, 11, 4, 5, 9, -1, -1, -1, -1, -1, -1, -1 },  /* 41: sgrady2 */
-		{ 0, 2, 4, 2, 5, 11, 2, 4, 5, -1, -1, -1, -1, -1, -1, -1 },  /* 42: touermi */
-		{ 3, 4, 8, 3, 4, 5, 2, 3, 5, 2, 5, 11, -1, -1, -1, -1 },  /* 43: tristanj */
-		{ 1, 2, 11, 2, 3, 10, 4, 5, 9, -1, -1, -1, -1, -1, -1, -1 },  /* 44: aphilli9 */
-		{ 8, 10, 11, 4, 5, 9, 0, 1, 8, 1, 8, 11, -1, -1, -1, -1 },  /* 45: chatfiel */
-		{ 0, 4, 5, 0, 3, 10, 0, 5, 10, 5, 10, 11, -1, -1, -1, -1 },  /* 46: chesshir */
-		{ 5, 8, 11, 8, 10, 11, 4, 5, 8, -1, -1, -1, -1, -1, -1, -1 },  /* 47: cneugass */
-		{ 5, 7, 9, 7, 8, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 48: cpalk */
-		{ 0, 3, 9, 3, 5, 7, 3, 5, 9, -1, -1, -1, -1, -1, -1, -1 },  /* 49: criegler */
-		{ 0, 8, 7, 0, 7, 1, 7, 1, 5, -1, -1, -1, -1, -1, -1, -1 },  /* 50: cworkman */
-		{ 1, 3, 5, 3, 5, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 51: hang */
-		{ 2, 3, 10, 7, 8, 9, 5, 7, 9, -1, -1, -1, -1, -1, -1, -1 },  /* 52: eewing */
-		{ 5, 7, 9, 2, 7, 10, 0, 2, 9, 6, 7, 9, -1, -1, -1, -1 },  /* 53: gmorriso */
-		{ 2, 3, 10, 7, 1, 5, 8, 1, 7, 0, 1, 8, -1, -1, -1, -1 },  /* 54: jbayes */
-		{ 10, 2, 1, 7, 5, 1, 10, 1, 7, -1, -1, -1, -1, -1, -1, -1 },  /* 55: jbrawner */
-		{ 7, 8, 9, 9, 5, 7, 1, 2, 11, -1, -1, -1, -1, -1, -1, -1 },  /* 56: jhorn3 */
-		{ 0, 1, 2, 0, 2, 3, 0, 1, 5, 2, 3, 7, -1, -1, -1, -1 },  /* 57: jlowen */
-		{ 0, 2, 8, 2, 5, 8, 2, 5, 11, 5, 7, 8, -1, -1, -1, -1 },  /* 58: jnelson */
-		{ 2, 5, 11, 2, 3, 5, 3, 5, 7, -1, -1, -1, -1, -1, -1, -1 },  /* 59: kdawes */
-		{ 9, 5, 8, 8, 7, 5, 11, 10, 3, 1, 3, 11, -1, -1, -1, -1 },  /* 60: kpinto */
-		{ 0, 1, 9, 5, 7, 11, 7, 10, 11, -1, -1, -1, -1, -1, -1, -1 },  /* 61: mcmillan */
-		{ 0, 3, 8, 5, 7, 11, 5, 10, 11, -1, -1, -1, -1, -1, -1, -1 },  /* 62: nivaldot */
-		{ 5, 7, 10, 5, 10, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 63: sgrady2 */
-		{ 6, 7, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 64: liuly */
-		{ 0, 3, 8, 6, 7, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 65: tristanj */
-		{ 0, 1, 9, 6, 7, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 66: aphilli9 */
-		{ 6, 7, 10, 1, 3, 8, 1, 8, 9, -1, -1, -1, -1, -1, -1, -1 },  /* 67: chatfiel */
-		{ 2, 3, 7, 2, 6, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 68: chesshir */
-		{ 0, 2, 6, 0, 6, 7, 0, 7, 8, -1, -1, -1, -1, -1, -1, -1 },  /* 69: cneugass */
-		{ 2, 3, 7, 2, 6, 7, 0, 1, 9, -1, -1, -1, -1, -1, -1, -1 },  /* 70: cpalk */
-		{ 6, 7, 8, 1, 8, 9, 1, 2, 6, 1, 6, 8, -1, -1, -1, -1 },  /* 71: criegler */
-		{ 1, 2, 11, 6, 7, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 72: cworkman */
-		{ 6, 7, 10, 0, 3, 8, 1, 2, 11, -1, -1, -1, -1, -1, -1, -1 },  /* 73: liuly */
-		{ 0, 2, 9, 2, 9, 11, 6, 7, 10, -1, -1, -1, -1, -1, -1, -1 },  /* 74: eewing */
-		{ 8, 9, 11, 6, 7, 10, 2, 3, 11, 3, 8, 11, -1, -1, -1, -1 },  /* 75: gmorriso */
-		{ 7, 3, 1, 7, 1, 11, 7, 6, 11, -1, -1, -1, -1, -1, -1, -1 },  /* 76: jbayes */
-		{ 7, 1, 11, 7, 6, 11, 0, 8, 1, 1, 8, 7, -1, -1, -1, -1 },  /* 77: jbrawner */
-		{ 0, 9, 11, 0, 3, 7, 0, 7, 11, 6, 7, 11, -1, -1, -1, -1 },  /* 78: jhorn3 */
-		{ 8, 9, 11, 7, 8, 11, 6, 7, 11, -1, -1, -1, -1, -1, -1, -1 },  /*79: Stephanie Labasan (3) */
-		{ 4, 8, 6, 10, 8, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 80: jnelson */
-		{ 0, 3, 6, 0, 4, 6, 3, 6, 10, -1, -1, -1, -1, -1, -1, -1 },  /* 81: kdawes */
-		{ 4, 8, 6, 0, 1, 9, 8, 10, 6, -1, -1, -1, -1, -1, -1, -1 },  /* 82: kpinto */
-		{ 1, 3, 9, 3, 4, 9, 3, 4, 10, 4, 6, 10, -1, -1, -1, -1 },  /* 83: mcmillan */
-		{ 3, 4, 8, 2, 3, 4, 2, 4, 6, -1, -1, -1, -1, -1, -1, -1 },  /* 84: nivaldot */
-		{ 0, 2, 4, 2, 4, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 85: sgrady2 */
-		{ 2, 4, 6, 0, 1, 9, 3, 4, 8, 2, 3, 4, -1, -1, -1, -1 },  /* 86: touermi */
-		{ 2, 4, 6, 1, 2, 4, 1, 4, 9, -1, -1, -1, -1, -1, -1, -1 },  /* 87: tristanj */
-		{ 1, 2, 11, 4, 7, 8, 6, 7, 10, -1, -1, -1, -1, -1, -1, -1 },  /* 88: aphilli9 */
-		{ 1, 2, 11, 0, 3, 10, 0, 6, 10, 0, 4, 6, -1, -1, -1, -1 },  /* 89: chatfiel */
-		{ 8, 4, 10, 10, 4, 6, 2, 0, 9, 9, 2, 11, -1, -1, -1, -1 },  /* 90: chesshir */
-		{ 3, 9, 11, 2, 3, 11, 3, 6, 10, 3, 4, 10, 3, 4, 9, -1 },  /* 91: cneugass */
-		{ 1, 3, 8, 1, 6, 11, 1, 6, 8, 4, 6, 8, -1, -1, -1, -1 },  /* 92: cpalk */
-		{ 0, 4, 6, 0, 1, 11, 0, 6, 11, -1, -1, -1, -1, -1, -1, -1 },  /* 93: criegler */
-		{ 3, 9, 11, 3, 4, 8, 3, 0, 9, 3, 4, 6, 3, 6, 11, -1 },  /* 94: cworkman */
-		{ 4, 6, 11, 4, 9, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 95: pem */
-		{ 4, 5, 9, 6, 7, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 96: roba */
-		{ 0, 3, 8, 4, 5, 9, 6, 7, 10, -1, -1, -1, -1, -1, -1, -1 },  /* 97: gmorriso */
-		{ 10, 6, 7, 0, 1, 5, 0, 4, 5, -1, -1, -1, -1, -1, -1, -1 },  /* 98: jbayes */
-		{ 3, 1, 5, 4, 3, 5, 7, 6, 10, 8, 3, 4, -1, -1, -1, -1 },  /* 99: jbrawner */
-		{ 4, 5, 9, 2, 3, 7, 2, 6, 7, -1, -1, -1, -1, -1, -1, -1 },  /* 100: jhorn3 */
-		{ 0, 2, 9, 4, 7, 8, 4, 5, 6, -1, -1, -1, -1, -1, -1, -1 },  /* 101: jlowen */
-		{ 0, 1, 5, 3, 6, 7, 2, 3, 6, 0, 4, 5, -1, -1, -1, -1 },  /* 102: jnelson */
-		{ 1, 2, 8, 1, 8, 5, 2, 6, 8, 4, 5, 8, 7, 8, 6, -1 },  /* 103: kdawes */
-		{ 4, 5, 9, 6, 7, 10, 1, 2, 11, -1, -1, -1, -1, -1, -1, -1 },  /* 104: kpinto */
-		{ 0, 1, 9, 2, 3, 10, 4, 7, 8, 5, 6, 11, -1, -1, -1, -1 },  /* 105: mcmillan */
-		{ 0, 2, 4, 2, 4, 5, 2, 5, 10, 6, 7, 11, -1, -1, -1, -1 },  /* 106: nivaldot */
-		{ 2, 3, 5, 2, 5, 11, 3, 4, 5, 3, 4, 8, 6, 7, 10, -1 },  /* 107: sgrady2 */
-		{ 4, 5, 9, 1, 6, 11, 1, 6, 7, 1, 3, 7, -1, -1, -1, -1 },  /* 108: touermi */
-		{ 0, 7, 8, 0, 1, 7, 1, 6, 7, 0, 6, 7, 4, 5, 9, -1 },  /* 109: tristanj */
-		{ 0, 1, 9, 1, 2, 11, 2, 3, 10, 4, 5, 9, 6, 7, 10, -1 },  /* 110: aphilli9 */
-		{ 4, 5, 11, 6, 7, 11, 4, 8, 11, 7, 8, 11, -1, -1, -1, -1 },  /* 111: chatfiel */
-		{ 8, 9, 10, 9, 5, 6, 9, 6, 10, -1, -1, -1, -1, -1, -1, -1 },  /* 112: chesshir */
-		{ 0, 5, 6, 0, 5, 9, 0, 3, 6, 3, 6, 10, -1, -1, -1, -1 },  /* 113: cneugass */
-		{ 0, 1, 5, 5, 6, 10, 0, 5, 10, 0, 8, 10, -1, -1, -1, -1 },  /* 114: cpalk */
-		{ 3, 5, 6, 3, 6, 10, 1, 3, 5, -1, -1, -1, -1, -1, -1, -1 },  /* 115: criegler */
-		{ 2, 8, 9, 2, 3, 9, 2, 5, 9, 2, 5, 6, -1, -1, -1, -1 },  /* 116: bishara */
-		{ 0, 2, 9, 2, 5, 9, 2, 5, 6, -1, -1, -1, -1, -1, -1, -1 },  /* 117: josh */
-		{ 0, 3, 8, 1, 2, 5, 2, 5, 6, -1, -1, -1, -1, -1, -1, -1 },  /* 118: annag */
-		{ 1, 2, 6, 1, 5, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 119: gmorriso */
-		{ 10, 9, 5, 1, 7, 11, 5, 6, 10, 8, 9, 10, -1, -1, -1, -1 },  /* 120: jbayes */
-		{ 3, 0, 10, 2, 11, 1, 6, 5, 9, 0, 9, 6, 6, 10, 0, -1 },  /* 121: jbrawner */
-		{ 0, 2, 5, 2, 5, 11, 5, 6, 10, 5, 8, 10, 0, 5, 8, -1 },  /* 122: jhorn3 */
-		{ 2, 3, 10, 5, 6, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 123: jlowen */
-		{ 3, 8, 6, 9, 8, 6, 9, 5, 6, 1, 3, 6, -1, -1, -1, -1 },  /* 124: jnelson */
-		{ 0, 1, 11, 0, 5, 6, 0, 5, 9, 0, 6, 11, -1, -1, -1, -1 },  /* 125: kdawes */
-		{ 11, 5, 6, 0, 3, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 126: kpinto */
-		{ 5, 6, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 127: mcmillan */
-		{ 5, 6, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 128: bishara */
-		{ 0, 3, 8, 5, 6, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 129: sgrady2 */
-		{ 0, 1, 9, 5, 6, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 130: touermi */
-		{ 5, 6, 11, 1, 3, 8, 1, 3, 9, -1, -1, -1, -1, -1, -1, -1 },  /* 131: tristanj */
-		{ 2, 3, 10, 5, 6, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 132: aphilli9 */
-		{ 5, 6, 11, 0, 2, 10, 0, 8, 10, -1, -1, -1, -1, -1, -1, -1 },  /* 133: chatfiel */
-		{ 0, 1, 9, 5, 6, 11, 2, 3, 10, -1, -1, -1, -1, -1, -1, -1 },  /* 134: chesshir */
-		{ 5, 6, 11, 2, 9, 10, 8, 9, 10, 1, 2, 9, -1, -1, -1, -1 },  /* 135: cneugass */
-		{ 1, 2, 6, 1, 5, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 136: cpalk */
-		{ 0, 3, 8, 1, 2, 6, 1, 5, 6, -1, -1, -1, -1, -1, -1, -1 },  /* 137: criegler */
-		{ 9, 5, 6, 9, 0, 6, 0, 2, 6, -1, -1, -1, -1, -1, -1, -1 },  /* 138: cworkman */
-		{ 1, 2, 9, 2, 9, 10, 9, 10, 8, -1, -1, -1, -1, -1, -1, -1 },  /* 139: annag */
-		{ 1, 3, 5, 3, 6, 10, 3, 5, 6, -1, -1, -1, -1, -1, -1, -1 },  /*140: James Kress (3) */
-		{ 0, 1, 5, 0, 8, 10, 5, 6, 10, 0, 5, 10, -1, -1, -1, -1 },  /* 141: gmorriso */
-		{ 0, 5, 9, 0, 5, 6, 0, 3, 6, 3, 6, 10, -1, -1, -1, -1 },  /* 142: liuly */
-		{ 6, 9, 5, 8, 9, 10, 10, 9, 6, -1, -1, -1, -1, -1, -1, -1 },  /* 143: jbrawner */
-		{ 4, 7, 8, 5, 6, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 144: jhorn3 */
-		{ 5, 6, 11, 0, 3, 4, 3, 4, 7, -1, -1, -1, -1, -1, -1, -1 },  /* 145: jlowen */
-		{ 0, 1, 9, 4, 7, 8, 5, 6, 11, -1, -1, -1, -1, -1, -1, -1 },  /* 146: jnelson */
-		{ 1, 3, 7, 5, 6, 11, 1, 7, 9, 4, 7, 9, -1, -1, -1, -1 },  /* 147: kdawes */
-		{ 7, 8, 4, 11, 5, 6, 2, 3, 10, -1, -1, -1, -1, -1, -1, -1 },  /* 148: kpinto */
-		{ 0, 2, 4, 2, 4, 5, 2, 5, 11, 7, 6, 10, -1, -1, -1, -1 },  /* 149: mcmillan */
-		{ 0, 1, 9, 2, 3, 11, 4, 7, 8, 5, 6, 10, -1, -1, -1, -1 },  /* 150: nivaldot */
-		{ 1, 2, 9, 2, 9, 10, 4, 7, 10, 4, 9, 10, 5, 6, 11, -1 },  /* 151: sgrady2 */
-		{ 1, 2, 6, 1, 5, 6, 4, 7, 8, -1, -1, -1, -1, -1, -1, -1 },  /* 152: touermi */
-		{ 0, 3, 4, 3, 4, 7, 1, 2, 5, 2, 5, 6, -1, -1, -1, -1 },  /* 153: tristanj */
-		{ 0, 1, 9, 1, 2, 11, 4, 7, 8, 5, 6, 11, -1, -1, -1, -1 },  /* 154: aphilli9 */
-		{ 5, 6, 9, 4, 7, 9, 2, 3, 9, 2, 6, 9, 3, 7, 9, -1 },  /* 155: chatfiel */
-		{ 8, 4, 7, 3, 1, 5, 3, 10, 5, 5, 10, 6, -1, -1, -1, -1 },  /* 156: chesshir */
-		{ 5, 6, 10, 4, 7, 10, 0, 4, 10, 1, 5, 10, 0, 1, 10, -1 },  /* 157: cneugass */
-		{ 4, 7, 8, 0, 5, 6, 0, 5, 9, 0, 3, 6, 3, 6, 10, -1 },  /* 158: cpalk */
-		{ 5, 6, 9, 6, 9, 10, 4, 7, 9, 7, 9, 10, -1, -1, -1, -1 },  /* 159: criegler */
-		{ 4, 9, 11, 6, 4, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 160: cworkman */
-		{ 0, 3, 8, 4, 6, 11, 4, 9, 11, -1, -1, -1, -1, -1, -1, -1 },  /*161: Monisha Balireddi (3) */
-		{ 0, 1, 11, 0, 6, 11, 0, 4, 6, -1, -1, -1, -1, -1, -1, -1 },  /* 162: hang */
-		{ 4, 6, 8, 1, 3, 8, 1, 6, 11, 1, 6, 8, -1, -1, -1, -1 },  /* 163: gmorriso */
-		{ 6, 11, 4, 9, 11, 4, 10, 2, 3, -1, -1, -1, -1, -1, -1, -1 },  /* 164: jbayes */
-		{ 10, 2, 8, 8, 2, 0, 6, 11, 4, 4, 11, 9, -1, -1, -1, -1 },  /* 165: jbrawner */
-		{ 2, 3, 10, 0, 1, 6, 1, 6, 11, 0, 4, 6, -1, -1, -1, -1 },  /* 166: jhorn3 */
-		{ 1, 2, 11, 4, 6, 8, 6, 8, 10, -1, -1, -1, -1, -1, -1, -1 },  /* 167: jlowen */
-		{ 1, 2, 4, 1, 4, 9, 2, 4, 6, -1, -1, -1, -1, -1, -1, -1 },  /* 168: jnelson */
-		{ 0, 3, 8, 1, 2, 9, 2, 4, 6, 2, 4, 9, -1, -1, -1, -1 },  /* 169: kdawes */
-		{ 0, 2, 4, 2, 4, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 170: kpinto */
-		{ 3, 4, 8, 2, 3, 4, 2, 4, 6, -1, -1, -1, -1, -1, -1, -1 },  /* 171: mcmillan */
-		{ 1, 3, 9, 3, 4, 9, 3, 4, 11, 4, 6, 11, -1, -1, -1, -1 },  /* 172: nivaldot */
-		{ 0, 1, 8, 1, 4, 6, 1, 4, 9, 1, 6, 10, 1, 8, 10, -1 },  /* 173: sgrady2 */
-		{ 0, 4, 6, 0, 3, 6, 3, 6, 10, -1, -1, -1, -1, -1, -1, -1 },  /* 174: touermi */
-		{ 4, 6, 8, 6, 8, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 175: tristanj */
-		{ 8, 9, 11, 6, 8, 11, 6, 7, 8, -1, -1, -1, -1, -1, -1, -1 },  /* 176: bishara */
-		{ 0, 3, 7, 0, 9, 11, 6, 7, 11, 0, 7, 11, -1, -1, -1, -1 },  /* 177: chatfiel */
-		{ 0, 1, 8, 1, 7, 8, 1, 7, 11, 7, 11, 6, -1, -1, -1, -1 },  /* 178: chesshir */
-		{ 6, 7, 11, 1, 3, 7, 1, 7, 11, -1, -1, -1, -1, -1, -1, -1 },  /* 179: cneugass */
-		{ 2, 3, 10, 6, 7, 8, 6, 8, 11, 8, 9, 11, -1, -1, -1, -1 },  /* 180: cpalk */
-		{ 0, 2, 7, 2, 7, 10, 0, 7, 9, 6, 7, 11, 7, 9, 11, -1 },  /* 181: criegler */
-		{ 2, 3, 10, 0, 1, 8, 6, 7, 11, 1, 8, 7, 1, 11, 7, -1 },  /* 182: cworkman */
-		{ 1, 2, 10, 1, 6, 11, 1, 6, 7, 1, 7, 10, -1, -1, -1, -1 },  /* 183: hang */
-		{ 6, 7, 8, 1, 2, 6, 1, 6, 8, 1, 8, 9, -1, -1, -1, -1 },  /* 184: liuly */
-		{ 1, 2, 9, 0, 3, 9, 3, 7, 9, 6, 7, 9, 2, 6, 9, -1 },  /* 185: gmorriso */
-		{ 0, 8, 7, 6, 7, 0, 2, 0, 6, -1, -1, -1, -1, -1, -1, -1 },  /* 186: jbayes */
-		{ 7, 3, 2, 7, 6, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 187: jbrawner */
-		{ 1, 3, 6, 1, 6, 9, 6, 8, 9, 6, 7, 8, 3, 6, 10, -1 },  /* 188: jhorn3 */
-		{ 0, 1, 9, 6, 7, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 189: jlowen */
-		{ 0, 3, 10, 0, 6, 7, 0, 6, 10, 0, 8, 7, -1, -1, -1, -1 },  /* 190: jnelson */
-		{ 6, 7, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 191: kdawes */
-		{ 11, 5, 10, 5, 7, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 192: kpinto */
-		{ 0, 3, 8, 5, 7, 10, 5, 10, 11, -1, -1, -1, -1, -1, -1, -1 },  /* 193: mcmillan */
-		{ 0, 1, 9, 5, 7, 10, 7, 10, 11, -1, -1, -1, -1, -1, -1, -1 },  /* 194: nivaldot */
-		{ 1, 3, 8, 1, 8, 9, 5, 7, 11, 7, 10, 11, -1, -1, -1, -1 },  /* 195: sgrady2 */
-		{ 3, 5, 7, 2, 3, 5, 2, 5, 11, -1, -1, -1, -1, -1, -1, -1 },  /* 196: touermi */
-		{ 0, 2, 8, 2, 5, 8, 5, 7, 8, 2, 5, 11, -1, -1, -1, -1 },  /* 197: tristanj */
-		{ 0, 1, 9, 2, 3, 10, 7, 6, 10, 5, 6, 11, -1, -1, -1, -1 },  /* 198: aphilli9 */
-		{ 2, 5, 11, 1, 2, 9, 2, 5, 7, 2, 7, 8, 2, 8, 9, -1 },  /* 199: chatfiel */
-		{ 1, 5, 7, 1, 2, 10, 7, 10, 1, -1, -1, -1, -1, -1, -1, -1 },  /* 200: chesshir */
-		{ 0, 3, 8, 1, 5, 7, 1, 2, 7, 2, 7, 10, -1, -1, -1, -1 },  /* 201: cneugass */
-		{ 0, 2, 9, 2, 7, 9, 2, 7, 10, 5, 7, 9, -1, -1, -1, -1 },  /* 202: cpalk */
-		{ 2, 3, 8, 2, 5, 9, 2, 5, 7, 2, 7, 10, 2, 8, 9, -1 },  /* 203: criegler */
-		{ 5, 7, 3, 3, 1, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 204: cworkman */
-		{ 1, 5, 7, 0, 7, 8, 0, 1, 7, -1, -1, -1, -1, -1, -1, -1 },  /* 205: ssane */
-		{ 3, 5, 7, 0, 3, 5, 0, 5, 9, -1, -1, -1, -1, -1, -1, -1 },  /* 206: bishara */
-		{ 5, 7, 9, 7, 8, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 207: gmorriso */
-		{ 8, 10, 11, 8, 5, 11, 8, 5, 4, -1, -1, -1, -1, -1, -1, -1 },  /* 208: jbayes */
-		{ 3, 0, 10, 5, 11, 10, 4, 5, 0, 10, 0, 5, -1, -1, -1, -1 },  /* 209: jbrawner */
-		{ 0, 1, 9, 4, 5, 11, 4, 8, 11, 8, 10, 11, -1, -1, -1, -1 },  /* 210: jhorn3 */
-		{ 4, 5, 9, 1, 3, 11, 3, 10, 11, -1, -1, -1, -1, -1, -1, -1 },  /* 211: jlowen */
-		{ 2, 3, 5, 2, 5, 11, 3, 4, 5, 3, 4, 8, -1, -1, -1, -1 },  /* 212: jnelson */
-		{ 0, 2, 4, 2, 4, 5, 2, 5, 11, -1, -1, -1, -1, -1, -1, -1 },  /* 213: kdawes */
-		{ 3, 5, 8, 2, 3, 11, 0, 1, 9, 4, 5, 8, 3, 5, 11, -1 },  /* 214: kpinto */
-		{ 1, 2, 11, 1, 5, 11, 1, 5, 9, 4, 5, 9, -1, -1, -1, -1 },  /* 215: mcmillan */
-		{ 1, 2, 5, 2, 5, 11, 4, 5, 11, 4, 8, 11, -1, -1, -1, -1 },  /* 216: nivaldot */
-		{ 0, 3, 10, 0, 4, 10, 1, 2, 10, 1, 5, 10, 4, 5, 10, -1 },  /* 217: sgrady2 */
-		{ 2, 5, 10, 0, 5, 9, 0, 2, 5, 4, 5, 8, 5, 8, 10, -1 },  /* 218: touermi */
-		{ 4, 5, 9, 2, 3, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 219: tristanj */
-		{ 1, 3, 5, 4, 5, 8, 3, 8, 5, -1, -1, -1, -1, -1, -1, -1 },  /*220: James Kress (3) */
-		{ 0, 1, 5, 0, 4, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 221: chatfiel */
-		{ 0, 5, 9, 0, 3, 5, 4, 5, 8, 3, 5, 8, -1, -1, -1, -1 },  /* 222: hang */
-		{ 4, 5, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 223: cneugass */
-		{ 4, 7, 10, 9, 10, 11, 4, 9, 10, -1, -1, -1, -1, -1, -1, -1 },  /* 224: cpalk */
-		{ 0, 3, 8, 9, 10, 11, 4, 7, 9, 7, 9, 10, -1, -1, -1, -1 },  /* 225: criegler */
-		{ 11, 10, 1, 1, 10, 4, 1, 0, 4, 4, 7, 10, -1, -1, -1, -1 },  /* 226: cworkman */
-		{ 4, 7, 8, 1, 3, 10, 1, 10, 11, -1, -1, -1, -1, -1, -1, -1 },  /* 227: bishara */
-		{ 3, 4, 7, 2, 3, 4, 2, 4, 9, 2, 9, 11, -1, -1, -1, -1 },  /* 228: josh */
-		{ 7, 9, 11, 0, 7, 8, 0, 2, 7, 4, 7, 9, 2, 7, 11, -1 },  /* 229: gmorriso */
-		{ 11, 2, 3, 11, 1, 0, 11, 7, 3, 11, 4, 7, 11, 4, 0, -1 },  /* 230: jbayes */
-		{ 2, 1, 11, 7, 4, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 231: jbrawner */
-		{ 1, 2, 9, 4, 7, 10, 4, 9, 10, 2, 9, 10, -1, -1, -1, -1 },  /* 232: jhorn3 */
-		{ 0, 1, 9, 2, 3, 10, 4, 7, 8, -1, -1, -1, -1, -1, -1, -1 },  /* 233: jlowen */
-		{ 0, 2, 4, 2, 4, 10, 4, 7, 10, -1, -1, -1, -1, -1, -1, -1 },  /* 234: jnelson */
-		{ 2, 4, 10, 2, 3, 4, 3, 4, 8, 4, 7, 10, -1, -1, -1, -1 },  /* 235: kdawes */
-		{ 1, 4, 9, 1, 3, 7, 1, 4, 7, -1, -1, -1, -1, -1, -1, -1 },  /* 236: kpinto */
-		{ 0, 1, 9, 0, 4, 9, 0, 4, 8, 4, 7, 8, -1, -1, -1, -1 },  /* 237: mcmillan */
-		{ 0, 3, 4, 3, 4, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 238: nivaldot */
-		{ 4, 7, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 239: sgrady2 */
-		{ 8, 9, 11, 8, 10, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 240: touermi */
-		{ 0, 3, 9, 3, 9, 10, 9, 10, 11, -1, -1, -1, -1, -1, -1, -1 },  /* 241: tristanj */
-		{ 0, 1, 11, 0, 11, 10, 0, 10, 8, -1, -1, -1, -1, -1, -1, -1 },  /*242: Brandon Hildreth (3)  1111 0010*/
-		{ 1, 3, 11, 3, 10, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 243: chatfiel */
-		{ 8, 9, 11, 2, 3, 8, 2, 8, 11, -1, -1, -1, -1, -1, -1, -1 },  /* 244: chesshir */
-		{ 2, 9, 11, 0, 2, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 245: cneugass */
-		{ 0, 1, 8, 2, 3, 8, 1, 8, 11, 2, 8, 11, -1, -1, -1, -1 },  /* 246: cpalk */
-		{ 1, 2, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 247: criegler */
-		{ 8, 9, 10, 9, 1, 10, 1, 2, 10, -1, -1, -1, -1, -1, -1, -1 },  /* 248: cworkman */
-		{ 0, 1, 9, 2, 3, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 249: josh */
-		{ 0, 2, 10, 0, 8, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /*250: Paul Elliott (2) */
-		{ 2, 3, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 251: gmorriso */
-		{ 1, 3, 8, 1, 8, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 252: jbayes */
-		{ 0, 1, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 253: jbrawner */
-		{ 0, 3, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 254: pem */
-		{ -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },  /* 255: jlowen */
-	};
-
-
-    vtkDataSetReader *rdr = vtkDataSetReader::New();
-    rdr->SetFileName("Isosurface.vtk");
-    rdr->Update();
+    for (int axis = 0 ; axis < 3 ; axis++)
+    {
+        int lo[3] = { idx[0], idx[1], idx[2] };
+        int hi[3] = { idx[0], idx[1], idx[2] };
+        if (idx[axis] > 0)
+            lo[axis]--;
+        if (idx[axis] < dims[axis]-1)
+            hi[axis]++;
+        float h = S.Coord(axis, hi[axis]) - S.Coord(axis, lo[axis]);
+        g[axis] = (h == 0.f ? 0.f : ((float) F[GetPointIndex(hi, dims)] - (float) F[GetPointIndex(lo, dims)]) / h);
+    }
+}
 
-    int dims[3];
-    vtkRectilinearGrid *rgrid = (vtkRectilinearGrid *) rdr->GetOutput();
-    rgrid->GetDimensions(dims);
 
-    float *X = (float *) rgrid->GetXCoordinates()->GetVoidPointer(0);
-	float *Y = (float *) rgrid->GetYCoordinates()->GetVoidPointer(0);
-	float *Z = (float *) rgrid->GetZCoordinates()->GetVoidPointer(0);
-    float *F = (float *) rgrid->GetPointData()->GetScalars()->GetVoidPointer(0);
+// ****************************************************************************
+//  Function: MarchingCubesKernel
+//
+//  Arguments:
+//      F:         the field values at the points, in their native type
+//      S:         the coordinates of the mesh (see GridSpacing.h)
+//      dims:      an array of size 3 with the number of points in X, Y, and Z.
+//      cells:     the range of cells to extract from, as first and one past
+//                 the last cell index in X, Y and Z
+//      isovalue, normals, tl: as for ExtractIsosurface
+//
+//  Returns:  None (argument tl is output)
+//
+// ****************************************************************************
+
+template <class T, class Spacing>
+void MarchingCubesKernel(const T *F, const Spacing &S, const int *dims, const int *cells,
+                         float isovalue, bool normals, TriangleList &tl)
+{
+	int i, j;
 
 	//Variables
 	int vert[8][3] = { { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 } };
 	int ptIdx[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+	float f[8];
 	float endPoints[16][3];
+	float endNormals[16][3];
+	float gradients[8][3];
 	int caseID = 0;
 
-    // Triangle List object using Triangle.h
-	TriangleList tl;
-
 	//Algorithm for drawing lines between endpoints on cells
-	for (int y = 0; y < 49; y++){
-		for (int x = 0; x < 49; x++){
-			for (int z = 0; z < 49; z++){
+	//x varies fastest in F, so it is the innermost loop
+	for (int z = cells[4]; z < cells[5]; z++){
+		for (int y = cells[2]; y < cells[3]; y++){
+			for (int x = cells[0]; x < cells[1]; x++){
 
 				//setting stuff to 0
 
@@ -578,122 +372,1328 @@ int main()
 				ptIdx[6] = GetPointIndex(vert[6], dims);
 				ptIdx[7] = GetPointIndex(vert[7], dims);
 
+				//field values at the vertices, in float whatever type F is stored as
+				for (i = 0; i < 8; i++){
+					f[i] = (float) F[ptIdx[i]];
+				}
+
 				//I incremented the case ID with 2^n, where n is the local vertex point
 				//This will make it easy to find the specific case
-				if (F[ptIdx[0]] <= 3.2){
+				if (f[0] <= isovalue){
 					caseID += 1;
 				}
-				if (F[ptIdx[1]] <= 3.2){
+				if (f[1] <= isovalue){
 					caseID += 2;
 				}
-				if (F[ptIdx[2]] <= 3.2){
+				if (f[2] <= isovalue){
 					caseID += 4;
 				}
-				if (F[ptIdx[3]] <= 3.2){
+				if (f[3] <= isovalue){
 					caseID += 8;
 				}
-				if (F[ptIdx[4]] <= 3.2){
+				if (f[4] <= isovalue){
 					caseID += 16;
 				}
-				if (F[ptIdx[5]] <= 3.2){
+				if (f[5] <= isovalue){
 					caseID += 32;
 				}
-				if (F[ptIdx[6]] <= 3.2){
+				if (f[6] <= isovalue){
 					caseID += 64;
 				}
-				if (F[ptIdx[7]] <= 3.2){
+				if (f[7] <= isovalue){
 					caseID += 128;
 				}
 
 				//for loop to interpolate on the edges held by triCase with the specific caseID
-				for (i = 0; i < 16; i++){
-					if (triCase[caseID][i] == -1){
-						break;
+				const uint8_t *caseEdges = triCase.edges + triCase.firstEdge[caseID];
+				int nedges = 3*triCase.triangleCount[caseID];
+				for (i = 0; i < nedges; i++){
+					if (caseEdges[i] == 0){
+						endPoints[i][0] = S.X(x) + ((isovalue - f[0]) / (f[1] - f[0]))*(S.X(x + 1) - S.X(x));
+						endPoints[i][1] = S.Y(y);
+						endPoints[i][2] = S.Z(z);
 					}
-					if (triCase[caseID][i] == 0){
-						endPoints[i][0] = X[x] + ((3.2 - F[ptIdx[0]]) / (F[ptIdx[1]] - F[ptIdx[0]]))*(X[x + 1] - X[x]);
-						endPoints[i][1] = Y[y];
-						endPoints[i][2] = Z[z];
+					else if (caseEdges[i] == 1){
+						endPoints[i][0] = S.X(x + 1);
+						endPoints[i][1] = S.Y(y);
+						endPoints[i][2] = S.Z(z) + ((isovalue - f[1]) / (f[3] - f[1]))*(S.Z(z + 1) - S.Z(z));
 					}
-					else if (triCase[caseID][i] == 1){
-						endPoints[i][0] = X[x + 1];
-						endPoints[i][1] = Y[y];
-						endPoints[i][2] = Z[z] + ((3.2 - F[ptIdx[1]]) / (F[ptIdx[3]] - F[ptIdx[1]]))*(Z[z + 1] - Z[z]);
+					else if (caseEdges[i] == 2){
+						endPoints[i][0] = S.X(x) + ((isovalue - f[2]) / (f[3] - f[2]))*(S.X(x + 1) - S.X(x));
+						endPoints[i][1] = S.Y(y);
+						endPoints[i][2] = S.Z(z + 1);
 					}
-					else if (triCase[caseID][i] == 2){
-						endPoints[i][0] = X[x] + ((3.2 - F[ptIdx[2]]) / (F[ptIdx[3]] - F[ptIdx[2]]))*(X[x + 1] - X[x]);
-						endPoints[i][1] = Y[y];
-						endPoints[i][2] = Z[z + 1];
+					else if (caseEdges[i] == 3){
+						endPoints[i][0] = S.X(x);
+						endPoints[i][1] = S.Y(y);
+						endPoints[i][2] = S.Z(z) + ((isovalue - f[0]) / (f[2] - f[0]))*(S.Z(z + 1) - S.Z(z));
 					}
-					else if (triCase[caseID][i] == 3){
-						endPoints[i][0] = X[x];
-						endPoints[i][1] = Y[y];
-						endPoints[i][2] = Z[z] + ((3.2 - F[ptIdx[0]]) / (F[ptIdx[2]] - F[ptIdx[0]]))*(Z[z + 1] - Z[z]);
+					else if (caseEdges[i] == 4){
+						endPoints[i][0] = S.X(x) + ((isovalue - f[4]) / (f[5] - f[4]))*(S.X(x + 1) - S.X(x));
+						endPoints[i][1] = S.Y(y + 1);
+						endPoints[i][2] = S.Z(z);
 					}
-					else if (triCase[caseID][i] == 4){
-						endPoints[i][0] = X[x] + ((3.2 - F[ptIdx[4]]) / (F[ptIdx[5]] - F[ptIdx[4]]))*(X[x + 1] - X[x]);
-						endPoints[i][1] = Y[y + 1];
-						endPoints[i][2] = Z[z];
+					else if (caseEdges[i] == 5){
+						endPoints[i][0] = S.X(x + 1);
+						endPoints[i][1] = S.Y(y + 1);
+						endPoints[i][2] = S.Z(z) + ((isovalue - f[5]) / (f[7] - f[5]))*(S.Z(z + 1) - S.Z(z));
 					}
-					else if (triCase[caseID][i] == 5){
-						endPoints[i][0] = X[x + 1];
-						endPoints[i][1] = Y[y + 1];
-						endPoints[i][2] = Z[z] + ((3.2 - F[ptIdx[5]]) / (F[ptIdx[7]] - F[ptIdx[5]]))*(Z[z + 1] - Z[z]);
+					else if (caseEdges[i] == 6){
+						endPoints[i][0] = S.X(x) + ((isovalue - f[6]) / (f[7] - f[6]))*(S.X(x + 1) - S.X(x));
+						endPoints[i][1] = S.Y(y + 1);
+						endPoints[i][2] = S.Z(z + 1);
 					}
-					else if (triCase[caseID][i] == 6){
-						endPoints[i][0] = X[x] + ((3.2 - F[ptIdx[6]]) / (F[ptIdx[7]] - F[ptIdx[6]]))*(X[x + 1] - X[x]);
-						endPoints[i][1] = Y[y + 1];
-						endPoints[i][2] = Z[z + 1];
+					else if (caseEdges[i] == 7){
+						endPoints[i][0] = S.X(x);
+						endPoints[i][1] = S.Y(y + 1);
+						endPoints[i][2] = S.Z(z) + ((isovalue - f[4]) / (f[6] - f[4]))*(S.Z(z + 1) - S.Z(z));
 					}
-					else if (triCase[caseID][i] == 7){
-						endPoints[i][0] = X[x];
-						endPoints[i][1] = Y[y + 1];
-						endPoints[i][2] = Z[z] + ((3.2 - F[ptIdx[4]]) / (F[ptIdx[6]] - F[ptIdx[4]]))*(Z[z + 1] - Z[z]);
+					else if (caseEdges[i] == 8){
+						endPoints[i][0] = S.X(x);
+						endPoints[i][1] = S.Y(y) + ((isovalue - f[0]) / (f[4] - f[0]))*(S.Y(y + 1) - S.Y(y));
+						endPoints[i][2] = S.Z(z);
 					}
-					else if (triCase[caseID][i] == 8){
-						endPoints[i][0] = X[x];
-						endPoints[i][1] = Y[y] + ((3.2 - F[ptIdx[0]]) / (F[ptIdx[4]] - F[ptIdx[0]]))*(Y[y + 1] - Y[y]);
-						endPoints[i][2] = Z[z];
+					else if (caseEdges[i] == 9){
+						endPoints[i][0] = S.X(x + 1);
+						endPoints[i][1] = S.Y(y) + ((isovalue - f[1]) / (f[5] - f[1]))*(S.Y(y + 1) - S.Y(y));
+						endPoints[i][2] = S.Z(z);
 					}
-					else if (triCase[caseID][i] == 9){
-						endPoints[i][0] = X[x + 1];
-						endPoints[i][1] = Y[y] + ((3.2 - F[ptIdx[1]]) / (F[ptIdx[5]] - F[ptIdx[1]]))*(Y[y + 1] - Y[y]);
-						endPoints[i][2] = Z[z];
+					else if (caseEdges[i] == 10){
+						endPoints[i][0] = S.X(x);
+						endPoints[i][1] = S.Y(y) + ((isovalue - f[2]) / (f[6] - f[2]))*(S.Y(y + 1) - S.Y(y));
+						endPoints[i][2] = S.Z(z + 1);
 					}
-					else if (triCase[caseID][i] == 10){
-						endPoints[i][0] = X[x];
-						endPoints[i][1] = Y[y] + ((3.2 - F[ptIdx[2]]) / (F[ptIdx[6]] - F[ptIdx[2]]))*(Y[y + 1] - Y[y]);
-						endPoints[i][2] = Z[z + 1];
+					else if (caseEdges[i] == 11){
+						endPoints[i][0] = S.X(x + 1);
+						endPoints[i][1] = S.Y(y) + ((isovalue - f[3]) / (f[7] - f[3]))*(S.Y(y + 1) - S.Y(y));
+						endPoints[i][2] = S.Z(z + 1);
 					}
-					else if (triCase[caseID][i] == 11){
-						endPoints[i][0] = X[x + 1];
-						endPoints[i][1] = Y[y] + ((3.2 - F[ptIdx[3]]) / (F[ptIdx[7]] - F[ptIdx[3]]))*(Y[y + 1] - Y[y]);
-						endPoints[i][2] = Z[z + 1];
+
+				}
+
+				//normals are interpolated between the gradients at the ends of each edge
+				if (normals && nedges > 0){
+					for (i = 0; i < 8; i++){
+						GetGradient(vert[i], dims, S, F, gradients[i]);
 					}
-					else{
-						break;
+					for (i = 0; i < nedges; i++){
+						const int *ev = triCaseEdgeVertices[caseEdges[i]];
+						float t = (isovalue - f[ev[0]]) / (f[ev[1]] - f[ev[0]]);
+						float length = 0;
+						for (j = 0; j < 3; j++){
+							endNormals[i][j] = gradients[ev[0]][j] + t*(gradients[ev[1]][j] - gradients[ev[0]][j]);
+							length += endNormals[i][j]*endNormals[i][j];
+						}
+						length = sqrt(length);
+						for (j = 0; j < 3 && length > 0; j++){
+							endNormals[i][j] /= length;
+						}
 					}
-
 				}
 
 				//Add the triangles
-				for (j = 0; j < 16; j++){
-					if (triCase[caseID][j] == -1){
-						break;
+				for (j = 0; j < nedges; j += 3){
+					if (normals){
+						tl.AddTriangle(endPoints[j], endPoints[j + 1], endPoints[j + 2], endNormals[j], endNormals[j + 1], endNormals[j + 2]);
+					}
+					else{
+						tl.AddTriangle(endPoints[j][0], endPoints[j][1], endPoints[j][2], endPoints[j + 1][0], endPoints[j + 1][1], endPoints[j + 1][2], endPoints[j + 2][0], endPoints[j + 2][1], endPoints[j + 2][2]);
 					}
-					tl.AddTriangle(endPoints[j][0], endPoints[j][1], endPoints[j][2], endPoints[j + 1][0], endPoints[j + 1][1], endPoints[j + 1][2], endPoints[j + 2][0], endPoints[j + 2][1], endPoints[j + 2][2]);
-					j += 2;
-
 				}
-				//End of z loop
+				//End of x loop
 			}
-			//End of x loop
+			//End of y loop
 		}
-		//End of y loop
+		//End of z loop
 	}
 	//End of algorithm
+}
+
+
+// ****************************************************************************
+//  Struct: MarchingCubes
+//
+//  Purpose:
+//      MarchingCubesKernel as a kernel for ExtractWithKernel.
+//
+// ****************************************************************************
+
+struct MarchingCubes
+{
+    template <class T, class Spacing>
+    void operator()(const T *F, const Spacing &S, const int *dims, const int *cells,
+                    float isovalue, bool normals, TriangleList &tl) const
+    {
+        MarchingCubesKernel(F, S, dims, cells, isovalue, normals, tl);
+    }
+};
+
+
+// ****************************************************************************
+//  Function: DispatchSpacing
+//
+//  Purpose:
+//      Picks the uniform spacing specialization of the kernel when the grid
+//      coordinates are evenly spaced.
+//
+// ****************************************************************************
+
+template <class Kernel, class T>
+void DispatchSpacing(const Kernel &kernel, const T *F, const RectilinearSpacing &rect, const int *dims,
+                     const int *cells, float isovalue, bool normals, TriangleList &tl)
+{
+    if (rect.IsUniform())
+        kernel(F, UniformSpacing(rect, dims), dims, cells, isovalue, normals, tl);
+    else
+        kernel(F, rect, dims, cells, isovalue, normals, tl);
+}
+
+
+// ****************************************************************************
+//  Function: ExtractWithKernel
+//
+//  Arguments:
+//      kernel:    called as kernel(F, S, dims, cells, isovalue, normals, tl)
+//                 with F typed as the scalars of the grid and S the spacing
+//      rgrid, isovalue, normals, extent, tl: as for ExtractIsosurface
+//
+//  Returns:  None (argument tl is output)
+//
+//  Notes:    Clamps the extent to the grid and instantiates the kernel for
+//            the scalar type of the grid and, when the coordinates are evenly
+//            spaced, for UniformSpacing. Every backend goes through here.
+//
+// ****************************************************************************
+
+template <class Kernel>
+void ExtractWithKernel(const Kernel &kernel, vtkRectilinearGrid *rgrid, float isovalue, bool normals,
+                       const int *extent, TriangleList &tl)
+{
+    int dims[3];
+    rgrid->GetDimensions(dims);
+    int cells[6] = { 0, dims[0]-1, 0, dims[1]-1, 0, dims[2]-1 };
+    for (int i = 0; i < 6 && extent != NULL; i++){
+        cells[i] = std::min(std::max(extent[i], 0), dims[i/2]-1);
+    }
+
+    RectilinearSpacing rect(rgrid);
+    vtkDataArray *scalars = rgrid->GetPointData()->GetScalars();
+    switch (scalars->GetDataType())
+    {
+        vtkTemplateMacro(DispatchSpacing(kernel, (const VTK_TT *) scalars->GetVoidPointer(0), rect, dims, cells,
+                                         isovalue, normals, tl));
+        default:
+            cerr << "Unsupported scalar type " << scalars->GetDataType() << endl;
+    }
+}
+
+
+// ****************************************************************************
+//  Function: GetMarchingCubesBlockKernel
+//
+//  Arguments:
+//      scalarType: the VTK type of the field values
+//      uniform:    whether the grid is evenly spaced
+//
+//  Returns:  the kernel instantiation for the type and spacing, or NULL if the
+//            type is not supported
+//
+//  Notes:    For callers such as the server that extract many blocks of the
+//            same grid and so pick the kernel once rather than per block.
+//
+// ****************************************************************************
+
+template <class T, bool Uniform>
+void MarchingCubesBlock(const void *F, const RectilinearSpacing &rect, const UniformSpacing &uniform,
+                        const int *dims, const int *cells, float isovalue, bool normals, TriangleList &tl)
+{
+    if constexpr (Uniform)
+        MarchingCubes()((const T *) F, uniform, dims, cells, isovalue, normals, tl);
+    else
+        MarchingCubes()((const T *) F, rect, dims, cells, isovalue, normals, tl);
+}
+
+MarchingCubesBlockKernel GetMarchingCubesBlockKernel(int scalarType, bool uniform)
+{
+    switch (scalarType)
+    {
+        vtkTemplateMacro(return (uniform ? &MarchingCubesBlock<VTK_TT, true> : &MarchingCubesBlock<VTK_TT, false>));
+    }
+    return NULL;
+}
+
+
+// ****************************************************************************
+//  Function: ExtractIsosurface
+//
+//  Arguments:
+//      rgrid:     the rectilinear grid holding the field F
+//      isovalue:  the value of F the surface is extracted at
+//      normals:   whether to compute a normal for each vertex of the surface
+//      extent:    the part of the grid to extract from, as the first and last
+//                 point index in X, Y and Z (the same as a VTK extent), or
+//                 NULL for the whole grid
+//      tl (output):  the list the triangles of the isosurface are added to
+//
+//  Returns:  None (argument tl is output)
+//
+//  Notes:    Normals are the gradient of F, interpolated along the crossed
+//            edge the same way as the vertex position, so smooth shading
+//            does not need a second pass over the surface.
+//
+//            The kernel is instantiated for the scalar type of the grid, so
+//            double, short, unsigned char, ... volumes are read in place
+//            instead of being converted to float first.
+//
+// ****************************************************************************
+
+void ExtractIsosurface(vtkRectilinearGrid *rgrid, float isovalue, bool normals, const int *extent,
+                       TriangleList &tl)
+{
+    ExtractWithKernel(MarchingCubes(), rgrid, isovalue, normals, extent, tl);
+}
+
+
+// ****************************************************************************
+//  Function: ParallelFor
+//
+//  Arguments:
+//      n:        the number of items
+//      nthreads: the number of threads to spread them over
+//      body:     called as body(begin, end) for consecutive ranges of items
+//
+//  Returns:  None, once every item has been processed
+//
+//  Notes:    Threads take small ranges from a shared counter rather than one
+//            fixed share each, since the surface, and so the work, usually
+//            sits in a few parts of the volume.
+//
+// ****************************************************************************
+
+template <class Body>
+void ParallelFor(int n, int nthreads, const Body &body)
+{
+    nthreads = std::min(nthreads, n);
+    if (nthreads <= 1)
+    {
+        if (n > 0)
+            body(0, n);
+        return;
+    }
+
+    int grain = std::max(n / (8*nthreads), 1);
+    std::atomic<int> next(0);
+    auto work = [&]()
+    {
+        for (int begin = next.fetch_add(grain) ; begin < n ; begin = next.fetch_add(grain))
+            body(begin, std::min(begin + grain, n));
+    };
+    std::vector<std::thread> pool;
+    for (int t = 1 ; t < nthreads ; t++)
+        pool.push_back(std::thread(work));
+    work();
+    for (size_t t = 0 ; t < pool.size() ; t++)
+        pool[t].join();
+}
+
+
+// ****************************************************************************
+//  Function: GetEdgePoint
+//
+//  Arguments:
+//      e:         the edge of the cell (numbered as in TriCase.h)
+//      x, y, z:   the logical index of the cell
+//      f:         the field values at the vertices of the cell
+//      S:         the coordinates of the mesh (see GridSpacing.h)
+//      isovalue:  the value of F the surface is extracted at
+//      p (output): the point on the edge where F is isovalue
+//
+//  Returns:  the interpolation parameter along the edge
+//
+//  Notes:    This does the same arithmetic as MarchingCubesKernel, so both
+//            kernels produce the same points.
+//
+// ****************************************************************************
+
+template <class Spacing>
+float GetEdgePoint(int e, int x, int y, int z, const float *f, const Spacing &S, float isovalue, float *p)
+{
+    const int *ev = triCaseEdgeVertices[e];
+    int lo[3] = { x + (ev[0] & 1), y + ((ev[0] >> 2) & 1), z + ((ev[0] >> 1) & 1) };
+    int axis = (e >= 8 ? 1 : ((e & 1) ? 2 : 0));
+    float t = (isovalue - f[ev[0]]) / (f[ev[1]] - f[ev[0]]);
+    p[0] = S.X(lo[0]);
+    p[1] = S.Y(lo[1]);
+    p[2] = S.Z(lo[2]);
+    p[axis] += t*(S.Coord(axis, lo[axis] + 1) - S.Coord(axis, lo[axis]));
+    return t;
+}
+
+
+// ****************************************************************************
+//  Function: FlyingEdgesKernel
+//
+//  Arguments:
+//      F, S, dims, cells, isovalue, normals, tl: as for MarchingCubesKernel
+//      nthreads:  the number of threads to extract with
+//
+//  Returns:  None (argument tl is output)
+//
+//  Notes:    Flying Edges (Schroeder, Maynard and Geveci, 2015) works on rows
+//            of points along X rather than on single cells, in four passes:
+//
+//              1. Every X edge is classified, one row at a time, and each row
+//                 records the first and one past the last edge the surface
+//                 crosses (its trim bounds).
+//              2. Each row of cells combines the classification and trim
+//                 bounds of the four point rows around it into a case for
+//                 every cell between the trims, and counts its triangles.
+//                 Outside the trims the four rows are constant, so the only
+//                 crossings there are Y/Z edges along the whole row, which
+//                 the trims are widened for.
+//              3. A prefix sum over the counts gives each row of cells the
+//                 place of its first triangle in the output.
+//              4. Each row of cells writes its triangles at that place, so
+//                 the rows are generated in parallel without locking.
+//
+//            Passes 1, 2 and 4 run in parallel over rows. The output is the
+//            same list of triangles, in the same order, as MarchingCubesKernel
+//            gives. The points and normals on the Y/Z edges a cell shares
+//            with the next cell in its row are computed once and carried
+//            along the row.
+//
+// ****************************************************************************
+
+template <class T, class Spacing>
+void FlyingEdgesKernel(const T *F, const Spacing &S, const int *dims, const int *cells,
+                       float isovalue, bool normals, TriangleList &tl, int nthreads)
+{
+    // Cells per row, and rows of points in Y and Z.
+    int nx = cells[1] - cells[0];
+    int ny = cells[3] - cells[2] + 1;
+    int nz = cells[5] - cells[4] + 1;
+    if (nx <= 0 || ny <= 1 || nz <= 1)
+        return;
+    int nrows = ny*nz;
+    int ncellRows = (ny-1)*(nz-1);
+
+    // Pass 1: classify the X edges. Bit 0 of an edge case is set if F is at
+    // or below the isovalue at the start of the edge, bit 1 at the end.
+    std::vector<uint8_t> edgeCases((size_t) nrows*nx);
+    std::vector<int> rowTrim(2*nrows);
+    ParallelFor(nrows, nthreads, [&](int begin, int end)
+    {
+        for (int r = begin ; r < end ; r++)
+        {
+            int idx[3] = { cells[0], cells[2] + r % ny, cells[4] + r / ny };
+            const T *row = F + GetPointIndex(idx, dims);
+            uint8_t *ec = &edgeCases[(size_t) r*nx];
+            int xL = nx, xR = 0;
+            int below = ((float) row[0] <= isovalue ? 1 : 0);
+            for (int i = 0 ; i < nx ; i++)
+            {
+                int nextBelow = ((float) row[i+1] <= isovalue ? 1 : 0);
+                ec[i] = (uint8_t) (below | (nextBelow << 1));
+                if (below != nextBelow)
+                {
+                    if (xL == nx)
+                        xL = i;
+                    xR = i+1;
+                }
+                below = nextBelow;
+            }
+            rowTrim[2*r] = xL;
+            rowTrim[2*r+1] = xR;
+        }
+    });
+
+    // Pass 2: trim each row of cells and count its triangles.
+    std::vector<int> cellTrim(2*ncellRows);
+    std::vector<int64_t> offsets(ncellRows+1);
+    ParallelFor(ncellRows, nthreads, [&](int begin, int end)
+    {
+        for (int c = begin ; c < end ; c++)
+        {
+            // The point rows at (y,z), (y,z+1), (y+1,z) and (y+1,z+1), which
+            // hold vertices 0-1, 2-3, 4-5 and 6-7 of the cells.
+            int r0 = (c / (ny-1))*ny + c % (ny-1);
+            int rows[4] = { r0, r0 + ny, r0 + 1, r0 + ny + 1 };
+            const uint8_t *ec[4];
+            int xL = nx, xR = 0;
+            for (int k = 0 ; k < 4 ; k++)
+            {
+                ec[k] = &edgeCases[(size_t) rows[k]*nx];
+                xL = std::min(xL, rowTrim[2*rows[k]]);
+                xR = std::max(xR, rowTrim[2*rows[k]+1]);
+            }
+
+            if (xL >= xR)
+            {
+                // No X edge crossings: the rows are constant, and the surface
+                // only passes through if they are not all on the same side.
+                if (ec[0][0] == ec[1][0] && ec[0][0] == ec[2][0] && ec[0][0] == ec[3][0])
+                    xL = xR = 0;
+                else
+                {
+                    xL = 0;
+                    xR = nx;
+                }
+            }
+            else
+            {
+                // Left of xL and right of xR the rows are constant, so the Y/Z
+                // edges there are crossed everywhere or nowhere.
+                if (xL > 0)
+                {
+                    int b = ec[0][xL] & 1;
+                    if ((ec[1][xL] & 1) != b || (ec[2][xL] & 1) != b || (ec[3][xL] & 1) != b)
+                        xL = 0;
+                }
+                if (xR < nx)
+                {
+                    int b = ec[0][xR] & 1;
+                    if ((ec[1][xR] & 1) != b || (ec[2][xR] & 1) != b || (ec[3][xR] & 1) != b)
+                        xR = nx;
+                }
+            }
+
+            int ntriangles = 0;
+            for (int i = xL ; i < xR ; i++)
+            {
+                int caseID = ec[0][i] | (ec[1][i] << 2) | (ec[2][i] << 4) | (ec[3][i] << 6);
+                ntriangles += triCase.triangleCount[caseID];
+            }
+            cellTrim[2*c] = xL;
+            cellTrim[2*c+1] = xR;
+            offsets[c+1] = ntriangles;
+        }
+    });
+
+    // Pass 3: prefix sum of the triangle counts.
+    offsets[0] = 0;
+    for (int c = 0 ; c < ncellRows ; c++)
+        offsets[c+1] += offsets[c];
+    if (offsets[ncellRows] == 0)
+        return;
+    int first = tl.AddTriangles(offsets[ncellRows], normals);
+
+    // Pass 4: generate the triangles of each row of cells at its offset.
+    // Edges 1, 5, 9 and 11 of a cell are edges 3, 7, 8 and 10 of the next.
+    static const int nextEdge[12] = { -1, 3, -1, -1, -1, 7, -1, -1, -1, 8, -1, 10 };
+    ParallelFor(ncellRows, nthreads, [&](int begin, int end)
+    {
+        float p[12][3];
+        float n[12][3];
+        float gradients[8][3];
+        float f[8];
+        for (int c = begin ; c < end ; c++)
+        {
+            if (offsets[c+1] == offsets[c])
+                continue;
+            int r0 = (c / (ny-1))*ny + c % (ny-1);
+            const uint8_t *ec[4] = { &edgeCases[(size_t) r0*nx], &edgeCases[(size_t) (r0 + ny)*nx],
+                                     &edgeCases[(size_t) (r0 + 1)*nx], &edgeCases[(size_t) (r0 + ny + 1)*nx] };
+            int y = cells[2] + c % (ny-1);
+            int z = cells[4] + c / (ny-1);
+            int xL = cellTrim[2*c], xR = cellTrim[2*c+1];
+            int tri = first + (int) offsets[c];
+            int carried = 0;
+            for (int i = xL ; i < xR ; i++)
+            {
+                int caseID = ec[0][i] | (ec[1][i] << 2) | (ec[2][i] << 4) | (ec[3][i] << 6);
+                int ntriangles = triCase.triangleCount[caseID];
+                if (ntriangles == 0)
+                {
+                    carried = 0;
+                    continue;
+                }
+
+                int x = cells[0] + i;
+                int vert[8][3];
+                for (int v = 0 ; v < 8 ; v++)
+                {
+                    vert[v][0] = x + (v & 1);
+                    vert[v][1] = y + ((v >> 2) & 1);
+                    vert[v][2] = z + ((v >> 1) & 1);
+                    f[v] = (float) F[GetPointIndex(vert[v], dims)];
+                }
+
+                // Work out the point (and normal) on every crossed edge,
+                // taking the ones on the shared face from the previous cell.
+                int gradientsDone = 0;
+                int nextCarried = 0;
+                for (int e = 0 ; e < 12 ; e++)
+                {
+                    const int *ev = triCaseEdgeVertices[e];
+                    if (((caseID >> ev[0]) & 1) == ((caseID >> ev[1]) & 1))
+                        continue;
+                    if (carried & (1 << e))
+                        continue;
+                    float t = GetEdgePoint(e, x, y, z, f, S, isovalue, p[e]);
+                    if (normals)
+                    {
+                        for (int k = 0 ; k < 2 ; k++)
+                            if (!(gradientsDone & (1 << ev[k])))
+                            {
+                                GetGradient(vert[ev[k]], dims, S, F, gradients[ev[k]]);
+                                gradientsDone |= 1 << ev[k];
+                            }
+                        float length = 0;
+                        for (int j = 0 ; j < 3 ; j++)
+                        {
+                            n[e][j] = gradients[ev[0]][j] + t*(gradients[ev[1]][j] - gradients[ev[0]][j]);
+                            length += n[e][j]*n[e][j];
+                        }
+                        length = sqrt(length);
+                        for (int j = 0 ; j < 3 && length > 0 ; j++)
+                            n[e][j] /= length;
+                    }
+                }
+
+                const uint8_t *caseEdges = triCase.edges + triCase.firstEdge[caseID];
+                for (int k = 0 ; k < 3*ntriangles ; k++)
+                {
+                    int e = caseEdges[k];
+                    float *pts = tl.GetTrianglePoints(tri + k/3) + 3*(k%3);
+                    pts[0] = p[e][0];
+                    pts[1] = p[e][1];
+                    pts[2] = p[e][2];
+                    if (normals)
+                    {
+                        float *nrm = tl.GetTriangleNormals(tri + k/3) + 3*(k%3);
+                        nrm[0] = n[e][0];
+                        nrm[1] = n[e][1];
+                        nrm[2] = n[e][2];
+                    }
+                }
+                tri += ntriangles;
+
+                for (int e = 0 ; e < 12 ; e++)
+                {
+                    const int *ev = triCaseEdgeVertices[e];
+                    if (nextEdge[e] < 0 || ((caseID >> ev[0]) & 1) == ((caseID >> ev[1]) & 1))
+                        continue;
+                    memcpy(p[nextEdge[e]], p[e], sizeof(p[e]));
+                    if (normals)
+                        memcpy(n[nextEdge[e]], n[e], sizeof(n[e]));
+                    nextCarried |= 1 << nextEdge[e];
+                }
+                carried = nextCarried;
+            }
+        }
+    });
+}
+
+
+// ****************************************************************************
+//  Struct: FlyingEdges
+//
+//  Purpose:
+//      FlyingEdgesKernel as a kernel for ExtractWithKernel, on nthreads
+//      threads.
+//
+// ****************************************************************************
+
+struct FlyingEdges
+{
+    int  nthreads;
+
+    template <class T, class Spacing>
+    void operator()(const T *F, const Spacing &S, const int *dims, const int *cells,
+                    float isovalue, bool normals, TriangleList &tl) const
+    {
+        FlyingEdgesKernel(F, S, dims, cells, isovalue, normals, tl, nthreads);
+    }
+};
+
+
+// ****************************************************************************
+//  Function: ExtractIsosurfaceFlyingEdges
+//
+//  Arguments:
+//      rgrid, isovalue, normals, extent, tl: as for ExtractIsosurface
+//
+//  Returns:  None (argument tl is output)
+//
+//  Notes:    Gives the same triangles as ExtractIsosurface, using the Flying
+//            Edges kernel on all the hardware threads of the machine.
+//
+// ****************************************************************************
+
+void ExtractIsosurfaceFlyingEdges(vtkRectilinearGrid *rgrid, float isovalue, bool normals, const int *extent,
+                                  TriangleList &tl)
+{
+    FlyingEdges kernel = { std::max((int) std::thread::hardware_concurrency(), 1) };
+    ExtractWithKernel(kernel, rgrid, isovalue, normals, extent, tl);
+}
+
+// ****************************************************************************
+//  Struct: IsosurfaceAlgorithm
+//
+//  Purpose:
+//      An extraction backend that can be picked with -algorithm. They all
+//      fill a TriangleList through the same interface as ExtractIsosurface.
+//
+// ****************************************************************************
+
+typedef void (*IsosurfaceExtractor)(vtkRectilinearGrid *rgrid, float isovalue, bool normals, const int *extent,
+                                    TriangleList &tl);
+
+struct IsosurfaceAlgorithm
+{
+    const char          *name;       // as given to -algorithm
+    const char          *cacheName;  // as used in surface cache keys
+    IsosurfaceExtractor  extract;
+};
+
+static const IsosurfaceAlgorithm algorithms[] =
+{
+    { "mc", "triCase",     ExtractIsosurface },
+    { "fe", "flyingEdges", ExtractIsosurfaceFlyingEdges }
+};
+static const int numAlgorithms = sizeof(algorithms) / sizeof(algorithms[0]);
+
+
+// ****************************************************************************
+//  Struct: BatchFrame
+//
+//  Purpose:
+//      One frame of a batch rendering script: the isovalue to extract and the
+//      camera to render the surface with.
+//
+// ****************************************************************************
+
+struct BatchFrame
+{
+    float   isovalue;
+    double  position[3];
+    double  focalPoint[3];
+    double  viewUp[3];
+};
+
+
+// ****************************************************************************
+//  Function: ReadBatchScript
+//
+//  Arguments:
+//      filename: a text file with one frame per line, in the form
+//                  isovalue [px py pz [fx fy fz [ux uy uz]]]
+//                where p is the camera position, f the focal point and u the
+//                view up vector. Anything after a '#' is ignored.
+//      frames (output): the frames of the script, in order
+//
+//  Returns:  false if the script could not be read
+//
+//  Notes:    The camera starts where the interactive window puts it and
+//            carries over from one frame to the next, so a script only needs
+//            to list camera values for the frames where the camera moves.
+//
+// ****************************************************************************
+
+bool ReadBatchScript(const char *filename, std::vector<BatchFrame> &frames)
+{
+    std::ifstream in(filename);
+    if (!in)
+    {
+        cerr << "Unable to open batch script " << filename << endl;
+        return false;
+    }
+
+    BatchFrame frame = { 0.f, { 0, 0, 30 }, { 0, 0, 0 }, { 0, 1, 0 } };
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(in, line))
+    {
+        lineNumber++;
+        size_t comment = line.find('#');
+        if (comment != std::string::npos)
+            line.erase(comment);
+
+        if (line.find_first_not_of(" \t\r") == std::string::npos)
+            continue;
+
+        std::istringstream fields(line);
+        if (!(fields >> frame.isovalue))
+        {
+            cerr << filename << ":" << lineNumber << ": expected an isovalue" << endl;
+            return false;
+        }
+
+        std::vector<double> camera;
+        double value;
+        while (fields >> value)
+            camera.push_back(value);
+        if (!fields.eof() || (camera.size() != 0 && camera.size() != 3 &&
+                              camera.size() != 6 && camera.size() != 9))
+        {
+            cerr << filename << ":" << lineNumber << ": expected an isovalue followed by "
+                 << "0, 3, 6 or 9 camera values" << endl;
+            return false;
+        }
+        for (size_t c = 0 ; c < camera.size() ; c++)
+        {
+            if (c < 3)
+                frame.position[c] = camera[c];
+            else if (c < 6)
+                frame.focalPoint[c-3] = camera[c];
+            else
+                frame.viewUp[c-6] = camera[c];
+        }
+        frames.push_back(frame);
+    }
+    return true;
+}
+
+
+// ****************************************************************************
+//  Class: VolumeFile
+//
+//  Purpose:
+//      A volume file that is only read the first time its grid is needed, so
+//      that runs answered entirely from the surface cache never read it.
+//      GetGrid() can be called from several threads; it returns NULL (and
+//      reports why) if the file is not a rectilinear grid with point scalars.
+//
+// ****************************************************************************
+
+class VolumeFile
+{
+   public:
+                   VolumeFile(const char *name) : filename(name), rdr(NULL), rgrid(NULL) {};
+     virtual      ~VolumeFile() { if (rdr != NULL) rdr->Delete(); };
+
+     inline const char   *GetFileName(void) const { return filename; };
+
+     inline vtkRectilinearGrid *GetGrid(void)
+     {
+         std::lock_guard<std::mutex> guard(lock);
+         if (rdr == NULL)
+         {
+             rdr = vtkDataSetReader::New();
+             rdr->SetFileName(filename);
+             rdr->Update();
+             rgrid = vtkRectilinearGrid::SafeDownCast(rdr->GetOutput());
+             if (rgrid == NULL || rgrid->GetPointData()->GetScalars() == NULL)
+             {
+                 cerr << filename << " is not a rectilinear grid with point scalars" << endl;
+                 rgrid = NULL;
+             }
+         }
+         return rgrid;
+     };
+
+   protected:
+     const char          *filename;
+     vtkDataSetReader    *rdr;
+     vtkRectilinearGrid  *rgrid;
+     std::mutex           lock;
+};
+
+
+// ****************************************************************************
+//  Function: ExtractFrame
+//
+//  Arguments:
+//      volume:    the volume file holding the field F, only read on a miss
+//      algorithm: the extraction backend to use
+//      isovalue:  the value of F the surface is extracted at
+//      normals:   whether to compute vertex normals
+//      tl:        scratch triangle list, emptied before extraction
+//      cache:     the surface cache to look in and store to, or NULL
+//      volumeHash: HashVolume() of the grid, if there is a cache
+//
+//  Returns:  a new vtkPolyData with the isosurface, which the caller deletes,
+//            or NULL if the volume could not be read or the surface does not
+//            fit in memory
+//
+// ****************************************************************************
+
+vtkPolyData *ExtractFrame(VolumeFile *volume, const IsosurfaceAlgorithm *algorithm, float isovalue,
+                          bool normals, TriangleList *tl, SurfaceCache *cache, uint64_t volumeHash)
+{
+    uint64_t key = 0;
+    if (cache != NULL)
+    {
+        key = SurfaceCache::MakeKey(volumeHash, algorithm->cacheName, isovalue, normals);
+        vtkPolyData *pd = cache->Find(key);
+        if (pd != NULL)
+            return pd;
+    }
+
+    vtkRectilinearGrid *rgrid = volume->GetGrid();
+    if (rgrid == NULL)
+        return NULL;
+    tl->Reset();
+    try
+    {
+        algorithm->extract(rgrid, isovalue, normals, NULL, *tl);
+    }
+    catch (std::bad_alloc &)
+    {
+        cerr << "Out of memory extracting the surface at " << isovalue << endl;
+        tl->Reset();
+        return NULL;
+    }
+    if (cache != NULL)
+        cache->Store(key, *tl);
+    return tl->MakePolyData();
+}
+
+
+// ****************************************************************************
+//  Function: RenderBatch
+//
+//  Arguments:
+//      volume:  the volume file holding the field F
+//      algorithm: the extraction backend to use
+//      frames:  the frames to render
+//      normals: whether to compute vertex normals for smooth shading
+//      cache, volumeHash: the surface cache to use, or NULL (see ExtractFrame)
+//      prefix:  output images are written to <prefix>0000.png, <prefix>0001.png, ...
+//      width, height: the size of the output images
+//
+//  Returns:  0 on success, for use as the exit code of the program; 1 as soon
+//            as a frame cannot be extracted or its image cannot be written
+//
+//  Notes:    Rendering happens offscreen, so no window is opened. On machines
+//            without a GPU or display, VTK has to be built with OSMesa
+//            (VTK_OPENGL_HAS_OSMESA) for the software rasterizer to be used.
+//
+//            Two triangle lists are kept so that the surface for the next
+//            frame is extracted on a worker thread while the current one is
+//            rendered and written. Consecutive frames with the same isovalue
+//            reuse the surface that is already in the mapper.
+//
+// ****************************************************************************
+
+int RenderBatch(VolumeFile *volume, const IsosurfaceAlgorithm *algorithm,
+                const std::vector<BatchFrame> &frames, bool normals, SurfaceCache *cache, uint64_t volumeHash,
+                const char *prefix, int width, int height)
+{
+    if (frames.empty())
+    {
+        cerr << "The batch script has no frames" << endl;
+        return 1;
+    }
+
+    vtkSmartPointer<vtkDataSetMapper> mapper =
+      vtkSmartPointer<vtkDataSetMapper>::New();
+    mapper->SetScalarRange(0, 0.15);
+
+    vtkSmartPointer<vtkActor> actor =
+      vtkSmartPointer<vtkActor>::New();
+    actor->SetMapper(mapper);
+
+    vtkSmartPointer<vtkRenderer> ren =
+      vtkSmartPointer<vtkRenderer>::New();
+    ren->AddActor(actor);
+    ren->SetBackground(0.0, 0.0, 0.0);
+
+    vtkSmartPointer<vtkRenderWindow> renWin =
+      vtkSmartPointer<vtkRenderWindow>::New();
+    renWin->SetOffScreenRendering(1);
+    renWin->AddRenderer(ren);
+    renWin->SetSize(width, height);
+
+    vtkSmartPointer<vtkWindowToImageFilter> w2i =
+      vtkSmartPointer<vtkWindowToImageFilter>::New();
+    w2i->SetInput(renWin);
+    w2i->SetInputBufferTypeToRGB();
+    w2i->ReadFrontBufferOff();
+
+    vtkSmartPointer<vtkPNGWriter> writer =
+      vtkSmartPointer<vtkPNGWriter>::New();
+    writer->SetInputConnection(w2i->GetOutputPort());
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    TriangleList lists[2];
+    int cur = 0;
+    vtkPolyData *pd = ExtractFrame(volume, algorithm, frames[0].isovalue, normals, &lists[cur], cache, volumeHash);
+    if (pd == NULL)
+        return 1;
+    for (size_t f = 0 ; f < frames.size() ; f++)
+    {
+        vtkPolyData *next = NULL;
+        std::thread worker;
+        if (f+1 < frames.size() && frames[f+1].isovalue != frames[f].isovalue)
+        {
+            float isovalue = frames[f+1].isovalue;
+            TriangleList *tl = &lists[1-cur];
+            worker = std::thread([volume, algorithm, isovalue, normals, tl, cache, volumeHash, &next]()
+                                 { next = ExtractFrame(volume, algorithm, isovalue, normals, tl, cache, volumeHash); });
+        }
+
+        mapper->SetInputData(pd);
+        vtkCamera *camera = ren->GetActiveCamera();
+        camera->SetFocalPoint(frames[f].focalPoint[0], frames[f].focalPoint[1], frames[f].focalPoint[2]);
+        camera->SetPosition(frames[f].position[0], frames[f].position[1], frames[f].position[2]);
+        camera->SetViewUp(frames[f].viewUp[0], frames[f].viewUp[1], frames[f].viewUp[2]);
+        ren->ResetCameraClippingRange();
+        renWin->Render();
+
+        char filename[1024];
+        snprintf(filename, sizeof(filename), "%s%04d.png", prefix, (int) f);
+        w2i->Modified();
+        writer->SetFileName(filename);
+        writer->Write();
+        bool written = (writer->GetErrorCode() == vtkErrorCode::NoError);
+        if (!written)
+            cerr << "Unable to write " << filename << endl;
+
+        if (worker.joinable())
+        {
+            worker.join();
+            pd->Delete();
+            pd = next;
+            cur = 1-cur;
+            if (pd == NULL)
+                return 1;
+        }
+        if (!written)
+        {
+            pd->Delete();
+            return 1;
+        }
+    }
+    pd->Delete();
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    cerr << "Rendered " << frames.size() << " frames in " << seconds << "s ("
+         << frames.size()/seconds << " frames/s)" << endl;
+    return 0;
+}
+
+
+// ****************************************************************************
+//  Function: RunBenchmark
+//
+//  Arguments:
+//      rgrid:    the rectilinear grid holding the field F
+//      isovalue: the value of F the surface is extracted at
+//      normals:  whether to compute vertex normals
+//      runs:     the number of times each backend extracts the surface
+//
+//  Returns:  0 on success, for use as the exit code of the program
+//
+//  Notes:    Times every backend in the algorithms table and VTK's own
+//            vtkContourFilter on the same volume and isovalue, so the fastest
+//            one can be picked per dataset. The backends are also checked
+//            against the first one: they should give the same triangles.
+//            vtkContourFilter produces a vtkPolyData, which is what the
+//            renderer needs, so the backends are timed through
+//            TriangleList::MakePolyData() as well; that step is also
+//            reported on its own.
+//
+//            The size of the surface in the compressed encoding of
+//            MeshCodec.h is reported too, with the encode and decode
+//            throughput in GB of triangles (as TriangleList lays them out)
+//            per second.
+//
+// ****************************************************************************
+
+int RunBenchmark(vtkRectilinearGrid *rgrid, float isovalue, bool normals, int runs)
+{
+    runs = std::max(runs, 1);
+    cout << "Isovalue " << isovalue << ", best and mean of " << runs << " run(s)"
+         << (normals ? ", with normals" : "") << endl;
+
+    std::vector<float> reference;
+    TriangleList tl;
+    for (int a = 0 ; a < numAlgorithms ; a++)
+    {
+        double best = 0, total = 0, extractBest = 0, polyDataBest = 0;
+        for (int r = 0 ; r < runs ; r++)
+        {
+            tl.Reset();
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            try
+            {
+                algorithms[a].extract(rgrid, isovalue, normals, NULL, tl);
+            }
+            catch (std::bad_alloc &)
+            {
+                cerr << "Out of memory extracting the surface with " << algorithms[a].name << endl;
+                return 1;
+            }
+            std::chrono::steady_clock::time_point extracted = std::chrono::steady_clock::now();
+            vtkPolyData *pd = tl.MakePolyData();
+            std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+            pd->Delete();
+
+            double extractMs = std::chrono::duration<double, std::milli>(extracted - start).count();
+            double polyDataMs = std::chrono::duration<double, std::milli>(end - extracted).count();
+            double ms = extractMs + polyDataMs;
+            best = (r == 0 ? ms : std::min(best, ms));
+            extractBest = (r == 0 ? extractMs : std::min(extractBest, extractMs));
+            polyDataBest = (r == 0 ? polyDataMs : std::min(polyDataBest, polyDataMs));
+            total += ms;
+        }
+
+        int ntriangles = tl.GetNumberOfTriangles();
+        cout << "  " << algorithms[a].name << ": " << ntriangles << " triangles, " << best << " ms best, "
+             << total/runs << " ms mean, " << ntriangles/(best*1000) << " Mtriangles/s (extract "
+             << extractBest << " ms, vtkPolyData " << polyDataBest << " ms best)";
+        if (a == 0)
+            reference.assign(tl.GetPoints(), tl.GetPoints() + 9*(size_t)ntriangles);
+        else if ((size_t) ntriangles*9 != reference.size())
+            cout << " (different triangles from " << algorithms[0].name << ")";
+        else
+        {
+            float diff = 0;
+            for (size_t i = 0 ; i < reference.size() ; i++)
+                diff = std::max(diff, std::fabs(tl.GetPoints()[i] - reference[i]));
+            cout << " (at most " << diff << " from " << algorithms[0].name << ")";
+        }
+        cout << endl;
+    }
+
+    vtkSmartPointer<vtkContourFilter> contour =
+      vtkSmartPointer<vtkContourFilter>::New();
+    contour->SetInputData(rgrid);
+    contour->SetValue(0, isovalue);
+    contour->SetComputeNormals(normals ? 1 : 0);
+    contour->ComputeScalarsOff();
+    double best = 0, total = 0;
+    for (int r = 0 ; r < runs ; r++)
+    {
+        contour->Modified();
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        contour->Update();
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        best = (r == 0 ? ms : std::min(best, ms));
+        total += ms;
+    }
+    vtkIdType ntriangles = contour->GetOutput()->GetNumberOfPolys();
+    cout << "  vtkContourFilter: " << ntriangles << " triangles, " << best << " ms best, "
+         << total/runs << " ms mean, " << ntriangles/(best*1000) << " Mtriangles/s" << endl;
+
+    double bounds[6];
+    rgrid->GetBounds(bounds);
+    double rawBytes = (normals ? 72. : 36.) * tl.GetNumberOfTriangles();
+    std::string encoded;
+    double encodeBest = 0, decodeBest = 0;
+    for (int r = 0 ; r < runs ; r++)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        encoded = MeshEncoder::Encode(tl, bounds);
+        if (encoded.empty())
+            return 1;
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        encodeBest = (r == 0 ? ms : std::min(encodeBest, ms));
+
+        start = std::chrono::steady_clock::now();
+        MeshDecoder decoder;
+        decoder.Decode(encoded.data(), encoded.size());
+        ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        decodeBest = (r == 0 ? ms : std::min(decodeBest, ms));
+    }
+    cout << "  mesh encoding: " << encoded.size() << " bytes (" << rawBytes/encoded.size() << "x smaller), encode "
+         << rawBytes/(encodeBest*1e6) << " GB/s, decode " << rawBytes/(decodeBest*1e6) << " GB/s";
+
+    // The decoded surface must have every triangle, with each corner within
+    // half a quantization step (plus float rounding) of where it was.
+    MeshDecoder decoder;
+    decoder.Decode(encoded.data(), encoded.size());
+    if (decoder.Failed() || decoder.GetNumberOfTriangles() != tl.GetNumberOfTriangles())
+    {
+        cout << " (decoded " << decoder.GetNumberOfTriangles() << " triangles"
+             << (decoder.Failed() ? ", stream corrupt" : "") << ")" << endl;
+        cerr << "The mesh encoding does not round trip" << endl;
+        return 1;
+    }
+    float limit[3], error[3] = { 0.f, 0.f, 0.f }, normalError = 0.f;
+    for (int i = 0 ; i < 3 ; i++)
+        limit[i] = 0.5f * (float) (bounds[2*i+1] - bounds[2*i]) / 65535.f +
+                   4 * FLT_EPSILON * (float) std::max(std::fabs(bounds[2*i]), std::fabs(bounds[2*i+1]));
+    const float *pts = tl.GetPoints();
+    const float *tlNormals = tl.GetNormals();
+    for (size_t k = 0 ; k < 3 * (size_t) tl.GetNumberOfTriangles() ; k++)
+    {
+        size_t v = (size_t) decoder.GetTriangles()[k];
+        for (int i = 0 ; i < 3 ; i++)
+        {
+            error[i] = std::max(error[i], std::fabs(decoder.GetPoints()[3*v+i] - pts[3*k+i]));
+            if (tlNormals != NULL)
+                normalError = std::max(normalError, std::fabs(decoder.GetNormals()[3*v+i] - tlNormals[3*k+i]));
+        }
+    }
+    bool accurate = (error[0] <= limit[0] && error[1] <= limit[1] && error[2] <= limit[2] &&
+                     normalError <= 0.5f / 32767.f + 4 * FLT_EPSILON);
+    cout << " (position error at most " << error[0] << ", " << error[1] << ", " << error[2];
+    if (tlNormals != NULL)
+        cout << ", normal error at most " << normalError;
+    cout << ")" << endl;
+    if (!accurate)
+    {
+        cerr << "The mesh encoding is off by more than half a quantization step" << endl;
+        return 1;
+    }
+    return 0;
+}
+
+
+// ****************************************************************************
+//  Function: main
+//
+//  Usage:    Isosurface [-normals] [-algorithm mc|fe] [-isovalue value]
+//                       [-cache dir [-cachesize MB]]
+//                       [-batch script] [-o prefix] [-size width height] [volume.vtk]
+//            Isosurface -benchmark runs [-normals] [-isovalue value] [volume.vtk]
+//            Isosurface -server socket [-workers N] [-maxrequest MB]
+//                       [-maxinflight MB] [volume.vtk ...]
+//
+//            The volume defaults to Isosurface.vtk. With no other arguments,
+//            the isosurface at 3.2 is shown in an interactive window. With -batch, the frames listed in the script
+//            (see ReadBatchScript) are rendered offscreen to PNG images.
+//            -normals computes vertex normals so the surface is smooth shaded.
+//            -algorithm picks the extraction backend: marching cubes (mc, the
+//            default) or Flying Edges (fe). -isovalue replaces 3.2 in the
+//            interactive window and the benchmark.
+//            -benchmark times both backends and vtkContourFilter instead.
+//            -cache keeps extracted surfaces in the given directory, up to
+//            -cachesize megabytes (1024 by default), and reuses them when the
+//            same volume and isovalue come up again.
+//            -server keeps the volumes loaded and answers requests on a Unix
+//            domain socket (see IsosurfaceServer.h) until it is killed.
+//
+// ****************************************************************************
+
+int main(int argc, char *argv[])
+{
+    const char *batchScript = NULL;
+    const char *prefix = "frame";
+    int width = 800, height = 800;
+    bool normals = false;
+    const IsosurfaceAlgorithm *algorithm = &algorithms[0];
+    float isovalue = 3.2f;
+    int benchmarkRuns = 0;
+    const char *cacheDir = NULL;
+    double cacheSize = 1024;
+    const char *serverSocket = NULL;
+    int workers = (int) std::thread::hardware_concurrency();
+    double maxRequest = 256, maxInFlight = 1024;
+    std::vector<const char *> volumeFiles;
+    for (int a = 1 ; a < argc ; a++)
+    {
+        if (strcmp(argv[a], "-normals") == 0)
+            normals = true;
+        else if (strcmp(argv[a], "-algorithm") == 0 && a+1 < argc)
+        {
+            const char *name = argv[++a];
+            algorithm = NULL;
+            for (int i = 0 ; i < numAlgorithms ; i++)
+                if (strcmp(name, algorithms[i].name) == 0)
+                    algorithm = &algorithms[i];
+            if (algorithm == NULL)
+            {
+                cerr << "Unknown algorithm " << name << "; use mc or fe" << endl;
+                return 1;
+            }
+        }
+        else if (strcmp(argv[a], "-isovalue") == 0 && a+1 < argc)
+            isovalue = (float) atof(argv[++a]);
+        else if (strcmp(argv[a], "-benchmark") == 0 && a+1 < argc)
+            benchmarkRuns = atoi(argv[++a]);
+        else if (strcmp(argv[a], "-cache") == 0 && a+1 < argc)
+            cacheDir = argv[++a];
+        else if (strcmp(argv[a], "-cachesize") == 0 && a+1 < argc)
+            cacheSize = atof(argv[++a]);
+        else if (strcmp(argv[a], "-server") == 0 && a+1 < argc)
+            serverSocket = argv[++a];
+        else if (strcmp(argv[a], "-workers") == 0 && a+1 < argc)
+            workers = atoi(argv[++a]);
+        else if (strcmp(argv[a], "-maxrequest") == 0 && a+1 < argc)
+            maxRequest = atof(argv[++a]);
+        else if (strcmp(argv[a], "-maxinflight") == 0 && a+1 < argc)
+            maxInFlight = atof(argv[++a]);
+        else if (argv[a][0] != '-')
+            volumeFiles.push_back(argv[a]);
+        else if (strcmp(argv[a], "-batch") == 0 && a+1 < argc)
+            batchScript = argv[++a];
+        else if (strcmp(argv[a], "-o") == 0 && a+1 < argc)
+            prefix = argv[++a];
+        else if (strcmp(argv[a], "-size") == 0 && a+2 < argc)
+        {
+            width = atoi(argv[++a]);
+            height = atoi(argv[++a]);
+        }
+        else
+        {
+            cerr << "Usage: " << argv[0] << " [-normals] [-algorithm mc|fe] [-isovalue value]"
+                 << " [-cache dir [-cachesize MB]]"
+                 << " [-batch script] [-o prefix] [-size width height] [volume.vtk]" << endl
+                 << "       " << argv[0] << " -benchmark runs [-normals] [-isovalue value] [volume.vtk]" << endl
+                 << "       " << argv[0] << " -server socket [-workers N] [-maxrequest MB]"
+                 << " [-maxinflight MB] [volume.vtk ...]" << endl;
+            return 1;
+        }
+    }
+
+    if (volumeFiles.empty())
+        volumeFiles.push_back("Isosurface.vtk");
+
+    if (serverSocket != NULL)
+    {
+        IsosurfaceServer server(workers, (int64_t) (maxRequest*1024*1024), (int64_t) (maxInFlight*1024*1024));
+        for (size_t v = 0 ; v < volumeFiles.size() ; v++)
+            if (!server.AddVolume(volumeFiles[v]))
+                return 1;
+        return server.Run(serverSocket);
+    }
+
+    VolumeFile volume(volumeFiles[0]);
+    if (benchmarkRuns > 0)
+    {
+        vtkRectilinearGrid *rgrid = volume.GetGrid();
+        return (rgrid != NULL ? RunBenchmark(rgrid, isovalue, normals, benchmarkRuns) : 1);
+    }
+
+    // With a cache the volume is only read if its hash is not in the index
+    // or a surface is missing; without one it is needed right away.
+    SurfaceCache *cache = NULL;
+    uint64_t volumeHash = 0;
+    if (cacheDir != NULL)
+    {
+        cache = new SurfaceCache(cacheDir, (uint64_t) (cacheSize*1024*1024));
+        if (!cache->FindVolumeHash(volume.GetFileName(), volumeHash))
+        {
+            vtkRectilinearGrid *rgrid = volume.GetGrid();
+            if (rgrid == NULL)
+            {
+                delete cache;
+                return 1;
+            }
+            volumeHash = HashVolume(rgrid);
+            cache->StoreVolumeHash(volume.GetFileName(), volumeHash);
+        }
+    }
+    else if (volume.GetGrid() == NULL)
+        return 1;
+
+    if (batchScript != NULL)
+    {
+        std::vector<BatchFrame> frames;
+        int rv = 1;
+        if (ReadBatchScript(batchScript, frames))
+            rv = RenderBatch(&volume, algorithm, frames, normals, cache, volumeHash, prefix, width, height);
+        if (cache != NULL)
+        {
+            cache->PrintStatistics(cerr);
+            delete cache;
+        }
+        return rv;
+    }
 
-    vtkPolyData *pd = tl.MakePolyData();
+    TriangleList tl;
+    vtkPolyData *pd = ExtractFrame(&volume, algorithm, isovalue, normals, &tl, cache, volumeHash);
+    if (cache != NULL)
+    {
+        cache->PrintStatistics(cerr);
+        delete cache;
+    }
+    if (pd == NULL)
+        return 1;
 
     //This can be useful for debugging
 /*
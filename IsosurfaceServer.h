@@ -0,0 +1,729 @@
+//This header file contains an IsosurfaceServer class that keeps volumes loaded and answers isosurface
+//requests over a local (Unix domain) socket, so clients do not pay for reading the volume and
+//starting a process on every query.
+//
+//A client sends one request per line and may send several requests on one connection:
+//
+//    isovalue=3.2 [volume=0] [extent=i0,i1,j0,j1,k0,k1] [format=raw|vtk|mesh] [normals=1]
+//    stats
+//
+//volume is the index of the volume in the order they were given to the server. extent limits the
+//extraction to part of the grid, as first and last point indices (a VTK extent). The server answers
+//
+//    OK <triangles> <milliseconds>\n<body>
+//    BUSY <message>\n        the request was not admitted; try again later
+//    ERROR <message>\n
+//
+//<milliseconds> is the time taken to extract the surface. The body is sent in chunks as it is
+//produced: each chunk is a line with its length in bytes followed by that many bytes, and a chunk
+//of length zero ends the body. An OK answer always carries the whole surface; if the server fails
+//while sending it, it closes the connection before the empty chunk.
+//
+//The raw format is the triangle points as nine floats per triangle in native byte order, followed
+//by the normals in the same layout if they were asked for. The vtk format is a binary legacy VTK
+//polydata file. The mesh format is the compressed encoding of MeshCodec.h, with the positions
+//quantized to the bounds of the volume. stats answers OK with a text report of the request metrics.
+#ifndef ISOSURFACESERVER_H
+#define ISOSURFACESERVER_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <queue>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <winsock2.h>
+#include <afunix.h>
+#ifndef IO_REPARSE_TAG_AF_UNIX
+#define IO_REPARSE_TAG_AF_UNIX 0x80000023L
+#endif
+#else
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include <vtkDataSetReader.h>
+#include <vtkPolyData.h>
+#include <vtkPolyDataWriter.h>
+#include <vtkRectilinearGrid.h>
+
+#include "GridSpacing.h"
+#include "MeshCodec.h"
+#include "TriangleList.h"
+
+// Defined in Isosurface.cxx.
+typedef void (*MarchingCubesBlockKernel)(const void *F, const RectilinearSpacing &rect, const UniformSpacing &uniform,
+                                         const int *dims, const int *cells, float isovalue, bool normals,
+                                         TriangleList &tl);
+MarchingCubesBlockKernel GetMarchingCubesBlockKernel(int scalarType, bool uniform);
+
+
+#ifdef _WIN32
+typedef SOCKET ServerSocket;
+static const ServerSocket InvalidServerSocket = INVALID_SOCKET;
+inline void CloseServerSocket(ServerSocket s) { closesocket(s); }
+#else
+typedef int ServerSocket;
+static const ServerSocket InvalidServerSocket = -1;
+inline void CloseServerSocket(ServerSocket s) { close(s); }
+#endif
+
+
+// ****************************************************************************
+//  Class: ServerVolume
+//
+//  Purpose:
+//      A volume held by the server, with the minimum and maximum of F over
+//      blocks of BlockSize^3 cells. Blocks whose range does not include the
+//      isovalue are skipped during extraction, and the number of blocks that
+//      do include it gives an estimate of the size of the surface before it
+//      is extracted. Everything the extraction needs from the grid (the
+//      spacing, the field pointer and the kernel for its type) is worked
+//      out once by Load(), so the blocks of a request only run the kernel.
+//
+// ****************************************************************************
+
+class ServerVolume
+{
+   public:
+     static const int  BlockSize = 8;
+
+                   ServerVolume() : reader(NULL), rgrid(NULL), rect(NULL), uniform(NULL), F(NULL), kernel(NULL) {};
+     virtual      ~ServerVolume()
+     {
+         delete rect;
+         delete uniform;
+         if (reader != NULL)
+             reader->Delete();
+     };
+
+     inline bool          Load(const char *file)
+     {
+         filename = file;
+         reader = vtkDataSetReader::New();
+         reader->SetFileName(file);
+         reader->Update();
+         rgrid = vtkRectilinearGrid::SafeDownCast(reader->GetOutput());
+         if (rgrid == NULL || rgrid->GetPointData()->GetScalars() == NULL)
+         {
+             cerr << file << " is not a rectilinear grid with point scalars" << endl;
+             return false;
+         }
+         rgrid->GetDimensions(dims);
+         // vtkDataSet::GetBounds() caches, so it is not safe to call from
+         // several workers at once.
+         rgrid->GetBounds(bounds);
+
+         vtkDataArray *scalars = rgrid->GetPointData()->GetScalars();
+         rect = new RectilinearSpacing(rgrid);
+         uniform = new UniformSpacing(*rect, dims);
+         F = scalars->GetVoidPointer(0);
+         kernel = GetMarchingCubesBlockKernel(scalars->GetDataType(), rect->IsUniform());
+
+         for (int axis = 0 ; axis < 3 ; axis++)
+             blocks[axis] = std::max((dims[axis]-2) / BlockSize + 1, 1);
+         switch (scalars->GetDataType())
+         {
+             vtkTemplateMacro(ComputeBlockRanges((const VTK_TT *) scalars->GetVoidPointer(0)));
+             default:
+                 cerr << file << " has an unsupported scalar type" << endl;
+                 return false;
+         }
+         return true;
+     };
+
+     // The point extent of a block; neighboring blocks share their boundary points.
+     inline void          GetBlockExtent(int bx, int by, int bz, int *ext) const
+     {
+         int b[3] = { bx, by, bz };
+         for (int axis = 0 ; axis < 3 ; axis++)
+         {
+             ext[2*axis] = b[axis]*BlockSize;
+             ext[2*axis+1] = std::min((b[axis]+1)*BlockSize, dims[axis]-1);
+         }
+     };
+
+     // Calls f(blockExtent) for every block in the extent the surface may pass through.
+     template <class Function>
+     inline void          ForEachActiveBlock(float isovalue, const int *extent, Function f) const
+     {
+         int lo[3], hi[3];
+         for (int axis = 0 ; axis < 3 ; axis++)
+         {
+             lo[axis] = std::max(extent[2*axis], 0) / BlockSize;
+             hi[axis] = std::min((std::max(extent[2*axis+1], 1)-1) / BlockSize, blocks[axis]-1);
+         }
+         for (int bz = lo[2] ; bz <= hi[2] ; bz++)
+         for (int by = lo[1] ; by <= hi[1] ; by++)
+         for (int bx = lo[0] ; bx <= hi[0] ; bx++)
+         {
+             int b = (bz*blocks[1]+by)*blocks[0]+bx;
+             if (isovalue < blockMin[b] || isovalue >= blockMax[b])
+                 continue;
+             int ext[6];
+             GetBlockExtent(bx, by, bz, ext);
+             for (int i = 0 ; i < 6 ; i += 2)
+             {
+                 ext[i] = std::max(ext[i], extent[i]);
+                 ext[i+1] = std::min(ext[i+1], extent[i+1]);
+             }
+             if (ext[0] < ext[1] && ext[2] < ext[3] && ext[4] < ext[5])
+                 f(ext);
+         }
+     };
+
+     // Adds the triangles in the point extent ext, which lies inside the grid.
+     inline void          ExtractBlock(const int *ext, float isovalue, bool normals, TriangleList &tl) const
+     {
+         kernel(F, *rect, *uniform, dims, ext, isovalue, normals, tl);
+     };
+
+     // A surface crossing a block cuts about BlockSize^2 of its cells, with
+     // about two triangles in each.
+     inline int64_t       EstimateTriangles(float isovalue, const int *extent) const
+     {
+         int64_t n = 0;
+         ForEachActiveBlock(isovalue, extent, [&n](const int *) { n += 2*BlockSize*BlockSize; });
+         return n;
+     };
+
+     std::string          filename;
+     vtkDataSetReader    *reader;
+     vtkRectilinearGrid  *rgrid;
+     int                  dims[3];
+     double               bounds[6];
+
+   protected:
+     RectilinearSpacing  *rect;
+     UniformSpacing      *uniform;
+     const void          *F;
+     MarchingCubesBlockKernel kernel;
+     int                  blocks[3];
+     std::vector<float>   blockMin;
+     std::vector<float>   blockMax;
+
+     template <class T>
+     inline void          ComputeBlockRanges(const T *F)
+     {
+         blockMin.assign(blocks[0]*blocks[1]*blocks[2], 0.f);
+         blockMax.assign(blocks[0]*blocks[1]*blocks[2], 0.f);
+         for (int bz = 0 ; bz < blocks[2] ; bz++)
+         for (int by = 0 ; by < blocks[1] ; by++)
+         for (int bx = 0 ; bx < blocks[0] ; bx++)
+         {
+             int ext[6];
+             GetBlockExtent(bx, by, bz, ext);
+             float lo = (float) F[(ext[4]*dims[1]+ext[2])*dims[0]+ext[0]], hi = lo;
+             for (int z = ext[4] ; z <= ext[5] ; z++)
+                 for (int y = ext[2] ; y <= ext[3] ; y++)
+                     for (int x = ext[0] ; x <= ext[1] ; x++)
+                     {
+                         float f = (float) F[(z*dims[1]+y)*dims[0]+x];
+                         lo = std::min(lo, f);
+                         hi = std::max(hi, f);
+                     }
+             blockMin[(bz*blocks[1]+by)*blocks[0]+bx] = lo;
+             blockMax[(bz*blocks[1]+by)*blocks[0]+bx] = hi;
+         }
+     };
+
+   private:
+                   ServerVolume(const ServerVolume &);
+     void          operator=(const ServerVolume &);
+};
+
+
+// ****************************************************************************
+//  Class: IsosurfaceServer
+//
+//  Purpose:
+//      Accepts connections on a Unix domain socket and hands them to a pool
+//      of worker threads, each with its own TriangleList. Requests whose
+//      estimated output would take the bytes being produced over
+//      maxInFlightBytes are answered with BUSY, and requests estimated above
+//      maxRequestBytes with ERROR, before any extraction is done.
+//
+// ****************************************************************************
+
+class IsosurfaceServer
+{
+   public:
+                   IsosurfaceServer(int nworkers, int64_t maxRequest, int64_t maxInFlight)
+                       : workers(std::max(nworkers, 1)), maxRequestBytes(maxRequest),
+                         maxInFlightBytes(maxInFlight), inFlightBytes(0)
+     {
+         requests = errors = rejected = 0;
+         totalMilliseconds = maxMilliseconds = 0.;
+         bytesSent = 0;
+     };
+     virtual      ~IsosurfaceServer()
+     {
+         for (size_t i = 0 ; i < volumes.size() ; i++)
+             delete volumes[i];
+     };
+
+     inline bool          AddVolume(const char *filename)
+     {
+         ServerVolume *volume = new ServerVolume;
+         if (!volume->Load(filename))
+         {
+             delete volume;
+             return false;
+         }
+         volumes.push_back(volume);
+         cerr << "Loaded volume " << volumes.size()-1 << ": " << filename << " ("
+              << volume->dims[0] << "x" << volume->dims[1] << "x" << volume->dims[2] << ")" << endl;
+         return true;
+     };
+
+     // Serves requests until the process is killed. Returns non-zero if the
+     // socket could not be set up.
+     inline int           Run(const char *socketPath)
+     {
+#ifdef _WIN32
+         WSADATA wsa;
+         if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0)
+         {
+             cerr << "Unable to initialize Winsock" << endl;
+             return 1;
+         }
+#else
+         signal(SIGPIPE, SIG_IGN);
+#endif
+         sockaddr_un address;
+         memset(&address, 0, sizeof(address));
+         address.sun_family = AF_UNIX;
+         if (strlen(socketPath) >= sizeof(address.sun_path))
+         {
+             cerr << "Socket path " << socketPath << " is too long" << endl;
+             return 1;
+         }
+         strcpy(address.sun_path, socketPath);
+         if (!RemoveStaleSocket(address))
+         {
+             cerr << "Unable to listen on " << socketPath << ": address in use" << endl;
+             return 1;
+         }
+
+         ServerSocket listener = socket(AF_UNIX, SOCK_STREAM, 0);
+         if (listener == InvalidServerSocket ||
+             bind(listener, (sockaddr *) &address, sizeof(address)) != 0 ||
+             listen(listener, 64) != 0)
+         {
+             cerr << "Unable to listen on " << socketPath << endl;
+             if (listener != InvalidServerSocket)
+                 CloseServerSocket(listener);
+             return 1;
+         }
+         cerr << "Serving " << volumes.size() << " volume(s) on " << socketPath
+              << " with " << workers << " worker(s)" << endl;
+
+         std::vector<std::thread> pool;
+         for (int i = 0 ; i < workers ; i++)
+             pool.push_back(std::thread([this]() { Work(); }));
+
+         for (;;)
+         {
+             ServerSocket connection = accept(listener, NULL, NULL);
+             if (connection == InvalidServerSocket)
+                 continue;
+             std::lock_guard<std::mutex> lock(queueMutex);
+             connections.push(connection);
+             queueReady.notify_one();
+         }
+     };
+
+   protected:
+     // Makes the socket path free to bind, removing a socket left behind by
+     // a server that is gone. Returns false, and removes nothing, if there is
+     // something else at the path or a server still answers on it.
+     static bool          RemoveStaleSocket(const sockaddr_un &address)
+     {
+#ifdef _WIN32
+         WIN32_FIND_DATAA found;
+         HANDLE find = FindFirstFileA(address.sun_path, &found);
+         if (find == INVALID_HANDLE_VALUE)
+             return true;
+         FindClose(find);
+         bool isSocket = ((found.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0 &&
+                          found.dwReserved0 == IO_REPARSE_TAG_AF_UNIX);
+#else
+         struct stat st;
+         if (lstat(address.sun_path, &st) != 0)
+             return true;
+         bool isSocket = S_ISSOCK(st.st_mode);
+#endif
+         if (!isSocket)
+             return false;
+
+         ServerSocket probe = socket(AF_UNIX, SOCK_STREAM, 0);
+         if (probe == InvalidServerSocket)
+             return false;
+         bool live = (connect(probe, (const sockaddr *) &address, sizeof(address)) == 0);
+         CloseServerSocket(probe);
+         return !live && remove(address.sun_path) == 0;
+     };
+
+     struct Request
+     {
+         int      volume;
+         float    isovalue;
+         int      extent[6];
+         bool     normals;
+         enum { RAW, VTK, MESH } format;
+     };
+
+     std::vector<ServerVolume *>   volumes;
+     int                           workers;
+     int64_t                       maxRequestBytes;
+     int64_t                       maxInFlightBytes;
+
+     std::mutex                    queueMutex;
+     std::condition_variable       queueReady;
+     std::queue<ServerSocket>      connections;
+
+     std::mutex                    admissionMutex;
+     int64_t                       inFlightBytes;
+
+     std::mutex                    metricsMutex;
+     int64_t                       requests;
+     int64_t                       errors;
+     int64_t                       rejected;
+     double                        totalMilliseconds;
+     double                        maxMilliseconds;
+     int64_t                       bytesSent;
+     std::vector<double>           recentMilliseconds;
+
+     inline void          Work(void)
+     {
+         TriangleList tl;
+         for (;;)
+         {
+             ServerSocket connection;
+             {
+                 std::unique_lock<std::mutex> lock(queueMutex);
+                 queueReady.wait(lock, [this]() { return !connections.empty(); });
+                 connection = connections.front();
+                 connections.pop();
+             }
+             Serve(connection, tl);
+             CloseServerSocket(connection);
+         }
+     };
+
+     // Answers the requests on one connection until the client closes it.
+     inline void          Serve(ServerSocket connection, TriangleList &tl)
+     {
+         std::string buffer;
+         char chunk[4096];
+         for (;;)
+         {
+             size_t newline;
+             while ((newline = buffer.find('\n')) == std::string::npos)
+             {
+                 if (buffer.size() > 65536)
+                     return;
+                 int n = recv(connection, chunk, sizeof(chunk), 0);
+                 if (n <= 0)
+                     return;
+                 buffer.append(chunk, n);
+             }
+             std::string line = buffer.substr(0, newline);
+             buffer.erase(0, newline+1);
+             if (!line.empty() && line[line.size()-1] == '\r')
+                 line.erase(line.size()-1);
+             if (line.find_first_not_of(" \t") == std::string::npos)
+                 continue;
+             if (!Answer(connection, line, tl))
+                 return;
+         }
+     };
+
+     inline bool          Answer(ServerSocket connection, const std::string &line, TriangleList &tl)
+     {
+         std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+         if (line == "stats")
+         {
+             std::string report = GetStatistics();
+             return SendBytes(connection, "OK 0 0\n", 7) && SendBody(connection, report.data(), report.size()) &&
+                    SendChunk(connection, NULL, 0);
+         }
+
+         Request request;
+         std::string error = ParseRequest(line, request);
+         if (!error.empty())
+         {
+             Record(start, 0, true, false);
+             return SendLine(connection, "ERROR " + error + "\n");
+         }
+
+         // Admission control, on the estimated size of the answer.
+         const ServerVolume *volume = volumes[request.volume];
+         int64_t estimate = volume->EstimateTriangles(request.isovalue, request.extent) *
+                         (request.normals ? 72 : 36);
+         if (estimate > maxRequestBytes)
+         {
+             Record(start, 0, true, false);
+             return SendLine(connection, "ERROR the surface is estimated at " + std::to_string(estimate) +
+                             " bytes, over the limit of " + std::to_string(maxRequestBytes) + "\n");
+         }
+         {
+             std::lock_guard<std::mutex> lock(admissionMutex);
+             if (inFlightBytes > 0 && inFlightBytes + estimate > maxInFlightBytes)
+             {
+                 Record(start, 0, false, true);
+                 return SendLine(connection, "BUSY " + std::to_string(inFlightBytes) +
+                                 " bytes of surfaces are being produced\n");
+             }
+             inFlightBytes += estimate;
+         }
+
+         // The list grows as needed, so only running out of memory can cut
+         // the surface short, and then the answer is an error.
+         bool extracted = true;
+         tl.Reset();
+         try
+         {
+             volume->ForEachActiveBlock(request.isovalue, request.extent, [&](const int *ext)
+                 { volume->ExtractBlock(ext, request.isovalue, request.normals, tl); });
+         }
+         catch (std::bad_alloc &)
+         {
+             extracted = false;
+         }
+         if (!extracted)
+         {
+             tl.Reset();
+             {
+                 std::lock_guard<std::mutex> lock(admissionMutex);
+                 inFlightBytes -= estimate;
+             }
+             Record(start, 0, true, false);
+             return SendLine(connection, "ERROR out of memory extracting the surface\n");
+         }
+
+         int ntriangles = tl.GetNumberOfTriangles();
+         double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+         char header[128];
+         int headerLength = snprintf(header, sizeof(header), "OK %d %.3f\n", ntriangles, ms);
+         bool sent = SendBytes(connection, header, headerLength);
+         size_t nbytes = 0;
+         if (request.format == Request::VTK)
+         {
+             vtkPolyData *pd = tl.MakePolyData();
+             vtkPolyDataWriter *writer = vtkPolyDataWriter::New();
+             writer->SetInputData(pd);
+             writer->SetFileTypeToBinary();
+             writer->WriteToOutputStringOn();
+             writer->Write();
+             nbytes = writer->GetOutputStringLength();
+             sent = sent && SendBody(connection, writer->GetOutputString(), nbytes);
+             writer->Delete();
+             pd->Delete();
+         }
+         else if (request.format == Request::MESH)
+         {
+             // Each chunk of the encoding is sent as soon as it is compressed.
+             std::string mesh;
+             MeshEncoder encoder(volume->bounds, request.normals, mesh);
+             for (int first = 0 ; sent && first < ntriangles ; first += MeshEncoder::ChunkTriangles)
+             {
+                 int n = std::min(MeshEncoder::ChunkTriangles, ntriangles - first);
+                 encoder.AddTriangles(tl.GetTrianglePoints(first),
+                                      (request.normals ? tl.GetTriangleNormals(first) : NULL), n);
+                 sent = !encoder.Failed() && SendChunk(connection, mesh.data(), mesh.size());
+                 nbytes += mesh.size();
+                 mesh.clear();
+             }
+             if (sent && !mesh.empty())
+             {
+                 sent = SendChunk(connection, mesh.data(), mesh.size());
+                 nbytes += mesh.size();
+             }
+         }
+         else
+         {
+             // Straight from the triangle list, without copying it.
+             nbytes = 9 * sizeof(float) * (size_t) ntriangles;
+             sent = sent && SendBody(connection, (const char *) tl.GetPoints(), nbytes);
+             if (tl.GetNormals() != NULL)
+             {
+                 sent = sent && SendBody(connection, (const char *) tl.GetNormals(), nbytes);
+                 nbytes *= 2;
+             }
+         }
+         sent = sent && SendChunk(connection, NULL, 0);
+         {
+             std::lock_guard<std::mutex> lock(admissionMutex);
+             inFlightBytes -= estimate;
+         }
+         // An answer that did not reach the client whole, because sending or
+         // encoding failed, is an error rather than a served request.
+         Record(start, (sent ? nbytes : 0), !sent, false);
+         return sent;
+     };
+
+     inline std::string   ParseRequest(const std::string &line, Request &request) const
+     {
+         request.volume = 0;
+         request.isovalue = 0.f;
+         request.normals = false;
+         request.format = Request::RAW;
+         bool haveIsovalue = false, haveExtent = false;
+
+         std::istringstream tokens(line);
+         std::string token;
+         while (tokens >> token)
+         {
+             size_t eq = token.find('=');
+             if (eq == std::string::npos)
+                 return "expected key=value, got " + token;
+             std::string key = token.substr(0, eq), value = token.substr(eq+1);
+             char *end = NULL;
+             if (key == "isovalue")
+             {
+                 request.isovalue = strtof(value.c_str(), &end);
+                 haveIsovalue = (end != value.c_str() && *end == '\0');
+                 if (!haveIsovalue)
+                     return "bad isovalue " + value;
+             }
+             else if (key == "volume")
+             {
+                 request.volume = (int) strtol(value.c_str(), &end, 10);
+                 if (end == value.c_str() || *end != '\0' || request.volume < 0 ||
+                     request.volume >= (int) volumes.size())
+                     return "no volume " + value;
+             }
+             else if (key == "extent")
+             {
+                 if (sscanf(value.c_str(), "%d,%d,%d,%d,%d,%d", &request.extent[0], &request.extent[1],
+                            &request.extent[2], &request.extent[3], &request.extent[4], &request.extent[5]) != 6)
+                     return "bad extent " + value;
+                 haveExtent = true;
+             }
+             else if (key == "format")
+             {
+                 if (value == "raw")
+                     request.format = Request::RAW;
+                 else if (value == "vtk")
+                     request.format = Request::VTK;
+                 else if (value == "mesh")
+                     request.format = Request::MESH;
+                 else
+                     return "unknown format " + value;
+             }
+             else if (key == "normals")
+                 request.normals = (value == "1");
+             else
+                 return "unknown key " + key;
+         }
+         if (!haveIsovalue)
+             return "no isovalue";
+         if (!haveExtent)
+         {
+             const int *dims = volumes[request.volume]->dims;
+             int whole[6] = { 0, dims[0]-1, 0, dims[1]-1, 0, dims[2]-1 };
+             memcpy(request.extent, whole, sizeof(whole));
+         }
+         return "";
+     };
+
+     inline bool          SendBytes(ServerSocket connection, const char *data, size_t size)
+     {
+         while (size > 0)
+         {
+             int n = send(connection, data, (int) std::min(size, (size_t) 1 << 20), 0);
+             if (n <= 0)
+                 return false;
+             data += n;
+             size -= n;
+         }
+         return true;
+     };
+     inline bool          SendLine(ServerSocket connection, const std::string &line)
+     {
+         return SendBytes(connection, line.data(), line.size());
+     };
+
+     // Sends one chunk of a body: its length on a line, then its bytes. A
+     // chunk of length zero ends the body.
+     inline bool          SendChunk(ServerSocket connection, const char *data, size_t size)
+     {
+         char length[32];
+         int n = snprintf(length, sizeof(length), "%llu\n", (unsigned long long) size);
+         return SendBytes(connection, length, n) && SendBytes(connection, data, size);
+     };
+
+     // Sends bytes that are already in memory, in chunks of at most 1 MB.
+     inline bool          SendBody(ServerSocket connection, const char *data, size_t size)
+     {
+         const size_t chunkSize = 1 << 20;
+         for (size_t offset = 0 ; offset < size ; offset += chunkSize)
+             if (!SendChunk(connection, data + offset, std::min(chunkSize, size - offset)))
+                 return false;
+         return true;
+     };
+
+     inline void          Record(std::chrono::steady_clock::time_point start, size_t nbytes, bool error, bool busy)
+     {
+         double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+         std::lock_guard<std::mutex> lock(metricsMutex);
+         requests++;
+         if (error)
+             errors++;
+         if (busy)
+             rejected++;
+         if (error || busy)
+             return;
+         totalMilliseconds += ms;
+         maxMilliseconds = std::max(maxMilliseconds, ms);
+         bytesSent += nbytes;
+         if (recentMilliseconds.size() == 1000)
+             recentMilliseconds.erase(recentMilliseconds.begin());
+         recentMilliseconds.push_back(ms);
+     };
+
+     inline std::string   GetStatistics(void)
+     {
+         std::lock_guard<std::mutex> lock(metricsMutex);
+         int64_t served = requests - errors - rejected;
+         std::vector<double> sorted(recentMilliseconds);
+         std::sort(sorted.begin(), sorted.end());
+         std::ostringstream out;
+         out << "requests " << requests << "\n"
+             << "served " << served << "\n"
+             << "errors " << errors << "\n"
+             << "busy " << rejected << "\n"
+             << "bytes_sent " << bytesSent << "\n"
+             << "mean_ms " << (served > 0 ? totalMilliseconds / served : 0.) << "\n"
+             << "max_ms " << maxMilliseconds << "\n";
+         if (!sorted.empty())
+             out << "p50_ms " << sorted[sorted.size()/2] << "\n"
+                 << "p95_ms " << sorted[std::min(sorted.size()-1, sorted.size()*95/100)] << "\n";
+         return out.str();
+     };
+};
+
+#endif
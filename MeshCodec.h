@@ -0,0 +1,384 @@
+//This header file contains a compact encoding for extracted isosurfaces, for sending them to remote
+//viewers and archiving them. MeshEncoder welds the triangle soup of a TriangleList into shared
+//vertices, quantizes the positions to 16 bits within the bounds of the grid, delta-encodes the
+//vertices and the triangle indices in the order they are first used, and compresses the result with
+//zlib. MeshDecoder reverses this and builds a vtkPolyData.
+//
+//Stream layout (native byte order):
+//
+//    StreamHeader
+//    ChunkHeader, compressed chunk
+//    ChunkHeader, compressed chunk
+//    ...
+//
+//Each chunk holds up to MeshEncoder::ChunkTriangles triangles and is decoded on its own, so a stream
+//can be written while the surface is produced and decoded while it arrives. Uncompressed, a chunk is
+//a series of variable length integers (seven bits per byte, low bits first):
+//
+//    nvertices x 3   zigzag deltas of the quantized positions from the previous vertex
+//    nvertices x 3   zigzag deltas of the quantized normals (if the stream has normals)
+//    ntriangles x 3  for each corner, how far back the vertex is from the next new one
+//                    (0 for a vertex used for the first time)
+#ifndef MESHCODEC_H
+#define MESHCODEC_H
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <vtk_zlib.h>
+#include <vtkCellArray.h>
+#include <vtkFloatArray.h>
+#include <vtkPointData.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+
+#include "TriangleList.h"
+
+
+struct MeshStreamHeader
+{
+    char      magic[8];
+    float     bounds[6];
+    int32_t   hasNormals;
+};
+
+struct MeshChunkHeader
+{
+    uint32_t  ntriangles;
+    uint32_t  nvertices;
+    uint32_t  rawSize;
+    uint32_t  compressedSize;
+};
+
+
+inline void WriteVarint(unsigned char *&p, uint32_t v)
+{
+    while (v >= 0x80)
+    {
+        *p++ = (unsigned char) (v | 0x80);
+        v >>= 7;
+    }
+    *p++ = (unsigned char) v;
+}
+
+inline bool ReadVarint(const unsigned char *&p, const unsigned char *end, uint32_t &v)
+{
+    v = 0;
+    for (int shift = 0 ; shift < 35 && p < end ; shift += 7)
+    {
+        unsigned char b = *p++;
+        v |= (uint32_t) (b & 0x7f) << shift;
+        if (!(b & 0x80))
+            return true;
+    }
+    return false;
+}
+
+inline uint32_t ZigZag(int32_t v) { return ((uint32_t) v << 1) ^ (uint32_t) (v >> 31); }
+inline int32_t  UnZigZag(uint32_t v) { return (int32_t) (v >> 1) ^ -(int32_t) (v & 1); }
+
+
+// ****************************************************************************
+//  Class: MeshEncoder
+//
+//  Purpose:
+//      Appends the encoding of triangles, laid out like TriangleList's, to a
+//      string. The stream header is written by the constructor and a chunk
+//      for every ChunkTriangles triangles by AddTriangles(). If zlib fails,
+//      Failed() turns true and no further chunks are written, so the stream
+//      is incomplete.
+//
+//  Notes:    Vertices are welded with TriangleList::Weld.
+//
+// ****************************************************************************
+
+class MeshEncoder
+{
+   public:
+     static const int ChunkTriangles = 65536;
+
+                   MeshEncoder(const double *gridBounds, bool normals, std::string &output, int level = 1)
+                       : out(output), hasNormals(normals), failed(false), compressionLevel(level)
+     {
+         MeshStreamHeader header;
+         memcpy(header.magic, "ISOMESH1", 8);
+         for (int i = 0 ; i < 6 ; i++)
+             header.bounds[i] = bounds[i] = (float) gridBounds[i];
+         header.hasNormals = (normals ? 1 : 0);
+         out.append((const char *) &header, sizeof(header));
+     };
+     virtual      ~MeshEncoder() {};
+
+     // normals must be given if the stream has normals and is ignored if not.
+     inline void          AddTriangles(const float *pts, const float *normals, int ntriangles)
+     {
+         for (int first = 0 ; !failed && first < ntriangles ; first += ChunkTriangles)
+         {
+             int n = std::min(ChunkTriangles, ntriangles - first);
+             EncodeChunk(pts + 9*(size_t)first, (hasNormals ? normals + 9*(size_t)first : NULL), n);
+         }
+     };
+
+     inline bool          Failed(void) const { return failed; };
+
+     // Returns the whole stream, or an empty string if zlib failed.
+     static std::string   Encode(const TriangleList &tl, const double *gridBounds, int level = 1)
+     {
+         std::string output;
+         MeshEncoder encoder(gridBounds, tl.GetNormals() != NULL, output, level);
+         encoder.AddTriangles(tl.GetPoints(), tl.GetNormals(), tl.GetNumberOfTriangles());
+         if (encoder.Failed())
+             output.clear();
+         return output;
+     };
+
+   protected:
+     std::string  &out;
+     bool          hasNormals;
+     bool          failed;
+     int           compressionLevel;
+     float         bounds[6];
+
+     std::vector<int>       ids;
+     std::vector<int>       firstUse;
+     std::vector<Bytef>     raw;
+     std::vector<Bytef>     compressed;
+
+     inline void          EncodeChunk(const float *pts, const float *normals, int ntriangles)
+     {
+         TriangleList::Weld(pts, ntriangles, ids, firstUse);
+         int nvertices = (int) firstUse.size();
+
+         // At most three bytes for every delta (17 bits) and index.
+         raw.resize(3*3*(2*(size_t)nvertices + 3*(size_t)ntriangles));
+         unsigned char *p = raw.data();
+         int32_t prev[3] = { 0, 0, 0 };
+         for (int v = 0 ; v < nvertices ; v++)
+             for (int i = 0 ; i < 3 ; i++)
+             {
+                 float range = bounds[2*i+1] - bounds[2*i];
+                 float q = (range > 0 ? (pts[3*firstUse[v]+i] - bounds[2*i]) / range * 65535.f : 0.f);
+                 int32_t qi = (int32_t) std::min(std::max(lrintf(q), 0L), 65535L);
+                 WriteVarint(p, ZigZag(qi - prev[i]));
+                 prev[i] = qi;
+             }
+         if (normals != NULL)
+         {
+             prev[0] = prev[1] = prev[2] = 0;
+             for (int v = 0 ; v < nvertices ; v++)
+                 for (int i = 0 ; i < 3 ; i++)
+                 {
+                     int32_t qi = (int32_t) std::min(std::max(lrintf(normals[3*firstUse[v]+i] * 32767.f), -32767L), 32767L);
+                     WriteVarint(p, ZigZag(qi - prev[i]));
+                     prev[i] = qi;
+                 }
+         }
+         int nextNew = 0;
+         for (int k = 0 ; k < 3*ntriangles ; k++)
+         {
+             WriteVarint(p, (uint32_t) (nextNew - ids[k]));
+             if (ids[k] == nextNew)
+                 nextNew++;
+         }
+
+         uLong rawSize = (uLong) (p - raw.data());
+         uLongf compressedSize = compressBound(rawSize);
+         compressed.resize(compressedSize);
+         int status = compress2(compressed.data(), &compressedSize, raw.data(), rawSize, compressionLevel);
+         if (status != Z_OK)
+         {
+             cerr << "Unable to compress a mesh chunk: " << zError(status) << endl;
+             failed = true;
+             return;
+         }
+
+         MeshChunkHeader header;
+         header.ntriangles = (uint32_t) ntriangles;
+         header.nvertices = (uint32_t) nvertices;
+         header.rawSize = (uint32_t) rawSize;
+         header.compressedSize = (uint32_t) compressedSize;
+         out.append((const char *) &header, sizeof(header));
+         out.append((const char *) compressed.data(), compressedSize);
+     };
+};
+
+
+// ****************************************************************************
+//  Class: MeshDecoder
+//
+//  Purpose:
+//      Decodes a stream written by MeshEncoder. Decode() can be called with
+//      the stream as it arrives; it decodes the complete chunks and returns
+//      how many bytes it used, so the caller passes the rest again once more
+//      data is in. MakePolyData() builds a vtkPolyData, with shared points,
+//      from everything decoded so far.
+//
+// ****************************************************************************
+
+class MeshDecoder
+{
+   public:
+                   MeshDecoder() : haveHeader(false), failed(false), ntriangles(0) { memset(&header, 0, sizeof(header)); };
+     virtual      ~MeshDecoder() {};
+
+     inline size_t        Decode(const void *data, size_t size)
+     {
+         const char *start = (const char *) data;
+         const char *p = start;
+         const char *end = start + size;
+         if (!haveHeader)
+         {
+             if ((size_t) (end - p) < sizeof(header))
+                 return 0;
+             memcpy(&header, p, sizeof(header));
+             if (memcmp(header.magic, "ISOMESH1", 8) != 0)
+             {
+                 failed = true;
+                 return 0;
+             }
+             haveHeader = true;
+             p += sizeof(header);
+         }
+
+         MeshChunkHeader chunk;
+         while (!failed && (size_t) (end - p) >= sizeof(chunk))
+         {
+             memcpy(&chunk, p, sizeof(chunk));
+             if ((size_t) (end - p) - sizeof(chunk) < chunk.compressedSize)
+                 break;
+             int npoints = GetNumberOfPoints();
+             if (!DecodeChunk(chunk, (const Bytef *) p + sizeof(chunk)))
+             {
+                 points.resize(3*(size_t)npoints);
+                 normals.resize(normals.empty() ? 0 : 3*(size_t)npoints);
+                 triangles.resize(3*(size_t)ntriangles);
+                 failed = true;
+                 break;
+             }
+             p += sizeof(chunk) + chunk.compressedSize;
+         }
+         return (size_t) (p - start);
+     };
+
+     // True if the stream was not written by MeshEncoder or is corrupt.
+     inline bool          Failed(void) const { return failed; };
+     inline int           GetNumberOfTriangles(void) const { return ntriangles; };
+     inline int           GetNumberOfPoints(void) const { return (int) (points.size() / 3); };
+     inline const float  *GetPoints(void) const { return points.data(); };
+     inline const float  *GetNormals(void) const { return (normals.empty() ? NULL : normals.data()); };
+     inline const int    *GetTriangles(void) const { return triangles.data(); };
+
+     inline vtkPolyData  *MakePolyData(void) const
+     {
+         int npoints = GetNumberOfPoints();
+         vtkFloatArray *coords = vtkFloatArray::New();
+         coords->SetNumberOfComponents(3);
+         coords->SetNumberOfTuples(npoints);
+         memcpy(coords->GetPointer(0), points.data(), points.size()*sizeof(float));
+         vtkPoints *vtk_pts = vtkPoints::New();
+         vtk_pts->SetData(coords);
+         coords->Delete();
+
+         vtkCellArray *tris = vtkCellArray::New();
+         tris->EstimateSize(ntriangles, 3);
+         for (int i = 0 ; i < ntriangles ; i++)
+         {
+             vtkIdType ids[3] = { triangles[3*i], triangles[3*i+1], triangles[3*i+2] };
+             tris->InsertNextCell(3, ids);
+         }
+
+         vtkPolyData *pd = vtkPolyData::New();
+         pd->SetPoints(vtk_pts);
+         pd->SetPolys(tris);
+         if (!normals.empty())
+         {
+             vtkFloatArray *vtk_normals = vtkFloatArray::New();
+             vtk_normals->SetName("Normals");
+             vtk_normals->SetNumberOfComponents(3);
+             vtk_normals->SetNumberOfTuples(npoints);
+             memcpy(vtk_normals->GetPointer(0), normals.data(), normals.size()*sizeof(float));
+             pd->GetPointData()->SetNormals(vtk_normals);
+             vtk_normals->Delete();
+         }
+         tris->Delete();
+         vtk_pts->Delete();
+         return pd;
+     };
+
+   protected:
+     MeshStreamHeader      header;
+     bool                  haveHeader;
+     bool                  failed;
+     int                   ntriangles;
+     std::vector<float>    points;
+     std::vector<float>    normals;
+     std::vector<int>      triangles;
+     std::vector<Bytef>    raw;
+
+     inline bool          DecodeChunk(const MeshChunkHeader &chunk, const Bytef *data)
+     {
+         // The encoder writes at most three bytes per varint, so a larger
+         // rawSize is corrupt and must not be allocated.
+         if (chunk.nvertices > 3*chunk.ntriangles || chunk.ntriangles > (uint32_t) MeshEncoder::ChunkTriangles ||
+             chunk.rawSize > 9*(2*(uint64_t)chunk.nvertices + 3*(uint64_t)chunk.ntriangles))
+             return false;
+         raw.resize(chunk.rawSize);
+         uLongf rawSize = chunk.rawSize;
+         if (uncompress(raw.data(), &rawSize, data, chunk.compressedSize) != Z_OK || rawSize != chunk.rawSize)
+             return false;
+         const unsigned char *p = raw.data();
+         const unsigned char *end = p + rawSize;
+
+         int base = GetNumberOfPoints();
+         float step[3];
+         for (int i = 0 ; i < 3 ; i++)
+             step[i] = (header.bounds[2*i+1] - header.bounds[2*i]) / 65535.f;
+         points.resize(3*((size_t) base + chunk.nvertices));
+         float *pt = points.data() + 3*(size_t)base;
+         int32_t q[3] = { 0, 0, 0 };
+         uint32_t v;
+         for (uint32_t i = 0 ; i < 3*chunk.nvertices ; i++)
+         {
+             if (!ReadVarint(p, end, v))
+                 return false;
+             q[i%3] += UnZigZag(v);
+             pt[i] = header.bounds[2*(i%3)] + q[i%3]*step[i%3];
+         }
+         if (header.hasNormals)
+         {
+             normals.resize(points.size());
+             float *n = normals.data() + 3*(size_t)base;
+             q[0] = q[1] = q[2] = 0;
+             for (uint32_t i = 0 ; i < 3*chunk.nvertices ; i++)
+             {
+                 if (!ReadVarint(p, end, v))
+                     return false;
+                 q[i%3] += UnZigZag(v);
+                 n[i] = q[i%3] / 32767.f;
+             }
+         }
+
+         triangles.resize(3*((size_t) ntriangles + chunk.ntriangles));
+         int *ids = triangles.data() + 3*(size_t)ntriangles;
+         uint32_t nextNew = 0;
+         for (uint32_t k = 0 ; k < 3*chunk.ntriangles ; k++)
+         {
+             if (!ReadVarint(p, end, v) || v > nextNew || (v == 0 && nextNew == chunk.nvertices))
+                 return false;
+             ids[k] = base + (int) (nextNew - v);
+             if (v == 0)
+                 nextNew++;
+         }
+         if (nextNew != chunk.nvertices || p != end)
+             return false;
+         ntriangles += chunk.ntriangles;
+         return true;
+     };
+};
+
+#endif
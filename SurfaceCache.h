@@ -0,0 +1,637 @@
+//This header file contains a SurfaceCache class that keeps extracted isosurfaces on disk, so that the
+//same (volume, isovalue) pair only has to be extracted once across runs and users. Each surface is
+//stored in its own file, named after a hash of the volume and the extraction parameters, as welded
+//points and connectivity. A hit maps the file and hands the mapped arrays to VTK without copying
+//them. A small index from the path, size and modification time of a volume file to its hash lets a
+//hit skip reading the volume at all.
+#ifndef SURFACECACHE_H
+#define SURFACECACHE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <vtkCellArray.h>
+#include <vtkDataArray.h>
+#include <vtkFloatArray.h>
+#include <vtkIdTypeArray.h>
+#include <vtkPointData.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+#include <vtkRectilinearGrid.h>
+#include <vtkVersionMacros.h>
+#if VTK_MAJOR_VERSION >= 9
+#include <vtkTypeInt32Array.h>
+#endif
+
+#include "TriangleList.h"
+
+
+// ****************************************************************************
+//  Function: HashBytes
+//
+//  Arguments:
+//      data, size: the bytes to hash
+//      hash:  the hash so far, so several buffers can be chained
+//
+//  Returns:  the 64-bit FNV-1a hash of the bytes
+//
+// ****************************************************************************
+
+inline uint64_t HashBytes(const void *data, size_t size, uint64_t hash = 14695981039346656037ULL)
+{
+    const unsigned char *bytes = (const unsigned char *) data;
+    for (size_t i = 0 ; i < size ; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+
+// ****************************************************************************
+//  Function: HashWords
+//
+//  Arguments:
+//      data:   the words to hash
+//      nwords: the number of 32-bit words
+//      hash:   the hash so far, so several buffers can be chained
+//
+//  Returns:  a 32-bit FNV-1a hash taken a word rather than a byte at a time,
+//            which is quick enough to checksum a cached surface on every hit
+//            and still changes with any change to a single word
+//
+// ****************************************************************************
+
+inline uint32_t HashWords(const void *data, size_t nwords, uint32_t hash = 2166136261u)
+{
+    const uint32_t *words = (const uint32_t *) data;
+    for (size_t i = 0 ; i < nwords ; i++)
+    {
+        hash ^= words[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+
+// ****************************************************************************
+//  Function: HashVolume
+//
+//  Arguments:
+//      rgrid: the rectilinear grid holding the field F
+//
+//  Returns:  a hash of the dimensions, coordinates and field values of the
+//            grid, which identifies the volume independent of its file name
+//
+// ****************************************************************************
+
+inline uint64_t HashVolume(vtkRectilinearGrid *rgrid)
+{
+    int dims[3];
+    rgrid->GetDimensions(dims);
+    uint64_t hash = HashBytes(dims, sizeof(dims));
+
+    vtkDataArray *arrays[4] = { rgrid->GetXCoordinates(), rgrid->GetYCoordinates(),
+                                rgrid->GetZCoordinates(), rgrid->GetPointData()->GetScalars() };
+    for (int i = 0 ; i < 4 ; i++)
+    {
+        int type = arrays[i]->GetDataType();
+        size_t size = (size_t) arrays[i]->GetNumberOfTuples() * arrays[i]->GetNumberOfComponents() *
+                      arrays[i]->GetDataTypeSize();
+        hash = HashBytes(&type, sizeof(type), hash);
+        hash = HashBytes(arrays[i]->GetVoidPointer(0), size, hash);
+    }
+    return hash;
+}
+
+
+// ****************************************************************************
+//  Class: MappedFile
+//
+//  Purpose:
+//      A copy-on-write memory mapping of a whole file: writes through
+//      GetData() never reach the file. GetData() is NULL if the file could
+//      not be mapped.
+//
+// ****************************************************************************
+
+class MappedFile
+{
+   public:
+                   MappedFile(const char *filename) : data(NULL), size(0)
+     {
+#ifdef _WIN32
+         mapping = NULL;
+         file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL,
+                            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+         if (file == INVALID_HANDLE_VALUE)
+             return;
+         LARGE_INTEGER fileSize;
+         if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+             return;
+         mapping = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+         if (mapping == NULL)
+             return;
+         data = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+         if (data != NULL)
+             size = (size_t) fileSize.QuadPart;
+#else
+         fd = open(filename, O_RDONLY);
+         if (fd < 0)
+             return;
+         struct stat st;
+         if (fstat(fd, &st) != 0 || st.st_size == 0)
+             return;
+         void *p = mmap(NULL, (size_t) st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+         if (p == MAP_FAILED)
+             return;
+         data = p;
+         size = (size_t) st.st_size;
+#endif
+     };
+     virtual      ~MappedFile()
+     {
+#ifdef _WIN32
+         if (data != NULL)
+             UnmapViewOfFile(data);
+         if (mapping != NULL)
+             CloseHandle(mapping);
+         if (file != INVALID_HANDLE_VALUE)
+             CloseHandle(file);
+#else
+         if (data != NULL)
+             munmap(data, size);
+         if (fd >= 0)
+             close(fd);
+#endif
+     };
+
+     inline void         *GetData(void) const { return data; };
+     inline size_t        GetSize(void) const { return size; };
+
+   protected:
+     void         *data;
+     size_t        size;
+#ifdef _WIN32
+     HANDLE        file;
+     HANDLE        mapping;
+#else
+     int           fd;
+#endif
+
+   private:
+                   MappedFile(const MappedFile &);
+     void          operator=(const MappedFile &);
+};
+
+
+// ****************************************************************************
+//  Function: WrapMappedArray
+//
+//  Arguments:
+//      array: the VTK array to point at the data
+//      data, n: the values, which live in file
+//      file:  the mapping holding the values
+//
+//  Notes:    VTK frees the values through FreeMappedArray(), which releases
+//            the mapping once no array uses it any more. VTK before 8.1 has
+//            no free callback, so there the values are copied.
+//
+// ****************************************************************************
+
+inline std::mutex &MappedArrayLock(void)
+{
+    static std::mutex lock;
+    return lock;
+}
+
+inline std::map<void *, std::shared_ptr<MappedFile> > &MappedArrays(void)
+{
+    static std::map<void *, std::shared_ptr<MappedFile> > arrays;
+    return arrays;
+}
+
+inline void FreeMappedArray(void *data)
+{
+    std::lock_guard<std::mutex> guard(MappedArrayLock());
+    MappedArrays().erase(data);
+}
+
+template <class Array, class T>
+inline void WrapMappedArray(Array *array, T *data, vtkIdType n, const std::shared_ptr<MappedFile> &file)
+{
+#if VTK_MAJOR_VERSION > 8 || (VTK_MAJOR_VERSION == 8 && VTK_MINOR_VERSION >= 1)
+    {
+        std::lock_guard<std::mutex> guard(MappedArrayLock());
+        MappedArrays()[data] = file;
+    }
+    array->SetArray(data, n, 0, Array::VTK_DATA_ARRAY_USER_DEFINED);
+    array->SetArrayFreeFunction(FreeMappedArray);
+#else
+    memcpy(array->WritePointer(0, n), data, n*sizeof(T));
+#endif
+}
+
+
+// ****************************************************************************
+//  Class: SurfaceCache
+//
+//  Purpose:
+//      A directory of cached surfaces with a size budget. When storing a
+//      surface pushes the directory over the budget, the least recently used
+//      surfaces are deleted; a hit counts as a use. Files are written under a
+//      temporary name and renamed into place, so several processes can share
+//      one cache directory; temporary files left behind by a failed write are
+//      deleted once they are an hour old.
+//
+//      Cache file layout (native byte order):
+//          Header
+//          float   points[3*npoints]
+//          float   normals[3*npoints]    (if hasNormals)
+//          int32_t triangles[3*ntriangles]
+//
+//      The header holds a HashWords() checksum of everything after it. Since
+//      the directory may be shared, a file is only used if the checksum
+//      matches and every triangle index is below npoints; anything else is
+//      a miss.
+//
+//      The volume index, volumes.idx, has a line for each volume file:
+//          <hash, 16 hex digits> <size> <modification time> <absolute path>
+//
+// ****************************************************************************
+
+class SurfaceCache
+{
+   public:
+     struct Header
+     {
+         char      magic[8];
+         uint64_t  key;
+         int32_t   ntriangles;
+         int32_t   npoints;
+         int32_t   hasNormals;
+         uint32_t  checksum;
+     };
+
+                   SurfaceCache(const char *dir, uint64_t budget) : directory(dir), maxBytes(budget)
+     {
+         hits = misses = stores = evictions = 0;
+         std::error_code ec;
+         std::filesystem::create_directories(directory, ec);
+         if (ec)
+             cerr << "Unable to create surface cache directory " << dir << ": " << ec.message() << endl;
+         Evict();
+     };
+     virtual      ~SurfaceCache() {};
+
+     // Combines the volume hash with everything else that changes the
+     // extracted surface.
+     static uint64_t      MakeKey(uint64_t volumeHash, const char *algorithm, float isovalue, bool normals)
+     {
+         const int version = 3;
+         int normalsFlag = (normals ? 1 : 0);
+         uint64_t key = HashBytes(&volumeHash, sizeof(volumeHash));
+         key = HashBytes(&version, sizeof(version), key);
+         key = HashBytes(algorithm, strlen(algorithm), key);
+         key = HashBytes(&isovalue, sizeof(isovalue), key);
+         return HashBytes(&normalsFlag, sizeof(normalsFlag), key);
+     };
+
+     // Looks up the hash of a volume file stored by StoreVolumeHash(). It is
+     // only found while the file keeps its size and modification time.
+     inline bool          FindVolumeHash(const char *path, uint64_t &hash) const
+     {
+         std::string stamp = GetVolumeStamp(path);
+         if (stamp.empty())
+             return false;
+         std::ifstream index(GetIndexName().c_str());
+         std::string line;
+         while (std::getline(index, line))
+         {
+             if (line.size() == 17 + stamp.size() && line.compare(17, std::string::npos, stamp) == 0)
+             {
+                 hash = strtoull(line.c_str(), NULL, 16);
+                 return true;
+             }
+         }
+         return false;
+     };
+
+     inline void          StoreVolumeHash(const char *path, uint64_t hash)
+     {
+         std::string stamp = GetVolumeStamp(path);
+         if (stamp.empty())
+             return;
+         std::string absolutePath = stamp.substr(stamp.find(' ', stamp.find(' ') + 1));
+
+         // Keep the most recent entries, dropping older ones for the same path.
+         const size_t maxEntries = 1024;
+         std::vector<std::string> lines;
+         std::ifstream index(GetIndexName().c_str());
+         std::string line;
+         while (std::getline(index, line))
+         {
+             if (line.size() > 17 && (line.size() < absolutePath.size() ||
+                 line.compare(line.size() - absolutePath.size(), std::string::npos, absolutePath) != 0))
+                 lines.push_back(line);
+         }
+         index.close();
+         char hex[32];
+         snprintf(hex, sizeof(hex), "%016llx ", (unsigned long long) hash);
+         lines.push_back(hex + stamp);
+         size_t first = (lines.size() > maxEntries ? lines.size() - maxEntries : 0);
+
+         std::string tmpname = GetTempName(GetIndexName());
+         FILE *f = fopen(tmpname.c_str(), "w");
+         if (f == NULL)
+             return;
+         bool ok = true;
+         for (size_t i = first ; i < lines.size() ; i++)
+             ok = (fprintf(f, "%s\n", lines[i].c_str()) > 0) && ok;
+         ok = (fclose(f) == 0) && ok;
+         std::error_code ec;
+         if (ok)
+             std::filesystem::rename(tmpname, GetIndexName(), ec);
+         if (!ok || ec)
+             std::filesystem::remove(tmpname, ec);
+     };
+
+     // Returns a new vtkPolyData with the cached surface, or NULL on a miss.
+     inline vtkPolyData  *Find(uint64_t key)
+     {
+         std::string filename = GetFileName(key);
+         std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>(filename.c_str());
+         Header *header = (Header *) file->GetData();
+         if (header == NULL || file->GetSize() < sizeof(Header) ||
+             memcmp(header->magic, "ISOSURF2", 8) != 0 || header->key != key ||
+             header->ntriangles < 0 || header->npoints < 0 || header->npoints > 3 * (int64_t) header->ntriangles ||
+             (header->hasNormals != 0 && header->hasNormals != 1) ||
+             file->GetSize() != sizeof(Header) + sizeof(float) * 3 * (size_t) header->npoints * (header->hasNormals ? 2 : 1) +
+                                sizeof(int32_t) * 3 * (size_t) header->ntriangles ||
+             !CheckContents(header, file->GetSize()))
+         {
+             misses++;
+             return NULL;
+         }
+
+         vtkPolyData *pd = MakePolyData(file, header);
+
+         std::error_code ec;
+         std::filesystem::last_write_time(filename, std::filesystem::file_time_type::clock::now(), ec);
+         hits++;
+         return pd;
+     };
+
+     inline void          Store(uint64_t key, const TriangleList &tl)
+     {
+         static_assert(sizeof(int) == sizeof(int32_t), "connectivity is written straight from the weld");
+         std::vector<int> ids, firstUse;
+         TriangleList::Weld(tl.GetPoints(), tl.GetNumberOfTriangles(), ids, firstUse);
+
+         Header header;
+         memcpy(header.magic, "ISOSURF2", 8);
+         header.key = key;
+         header.ntriangles = tl.GetNumberOfTriangles();
+         header.npoints = (int32_t) firstUse.size();
+         header.hasNormals = (tl.GetNormals() != NULL ? 1 : 0);
+
+         size_t nfloats = 3 * firstUse.size();
+         std::vector<float> points(nfloats), normals(header.hasNormals ? nfloats : 0);
+         for (size_t v = 0 ; v < firstUse.size() ; v++)
+         {
+             memcpy(&points[3*v], tl.GetPoints() + 3*(size_t)firstUse[v], 3*sizeof(float));
+             if (header.hasNormals)
+                 memcpy(&normals[3*v], tl.GetNormals() + 3*(size_t)firstUse[v], 3*sizeof(float));
+         }
+
+         uint32_t checksum = HashWords(points.data(), points.size());
+         checksum = HashWords(normals.data(), normals.size(), checksum);
+         header.checksum = HashWords(ids.data(), ids.size(), checksum);
+
+         std::string filename = GetFileName(key);
+         std::string tmpname = GetTempName(filename);
+         FILE *f = fopen(tmpname.c_str(), "wb");
+         if (f == NULL)
+         {
+             cerr << "Unable to write surface cache file " << tmpname << endl;
+             return;
+         }
+         bool ok = (fwrite(&header, sizeof(header), 1, f) == 1 &&
+                    fwrite(points.data(), sizeof(float), nfloats, f) == nfloats &&
+                    (!header.hasNormals || fwrite(normals.data(), sizeof(float), nfloats, f) == nfloats) &&
+                    fwrite(ids.data(), sizeof(int32_t), ids.size(), f) == ids.size());
+         ok = (fclose(f) == 0) && ok;
+
+         std::error_code ec;
+         if (ok)
+             std::filesystem::rename(tmpname, filename, ec);
+         if (!ok || ec)
+         {
+             cerr << "Unable to write surface cache file " << filename << endl;
+             std::filesystem::remove(tmpname, ec);
+             return;
+         }
+         stores++;
+         Evict();
+     };
+
+     inline void          PrintStatistics(std::ostream &out) const
+     {
+         uint64_t lookups = hits + misses;
+         out << "Surface cache: " << hits << " hits, " << misses << " misses";
+         if (lookups > 0)
+             out << " (" << (100.0 * hits) / lookups << "% hit rate)";
+         out << ", " << stores << " stored, " << evictions << " evicted" << endl;
+     };
+
+   protected:
+     std::string   directory;
+     uint64_t      maxBytes;
+     uint64_t      hits;
+     uint64_t      misses;
+     uint64_t      stores;
+     uint64_t      evictions;
+
+     inline std::string   GetFileName(uint64_t key) const
+     {
+         char name[32];
+         snprintf(name, sizeof(name), "%016llx.surf", (unsigned long long) key);
+         return (std::filesystem::path(directory) / name).string();
+     };
+     inline std::string   GetIndexName(void) const
+     {
+         return (std::filesystem::path(directory) / "volumes.idx").string();
+     };
+     static std::string   GetTempName(const std::string &filename)
+     {
+         return filename + ".tmp" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count());
+     };
+
+     // Returns "<size> <modification time> <absolute path>" for a volume
+     // file, or an empty string if the file cannot be found.
+     static std::string   GetVolumeStamp(const char *path)
+     {
+         std::error_code ec;
+         std::filesystem::path absolutePath = std::filesystem::absolute(path, ec).lexically_normal();
+         uintmax_t size = std::filesystem::file_size(absolutePath, ec);
+         if (ec)
+             return "";
+         std::filesystem::file_time_type modified = std::filesystem::last_write_time(absolutePath, ec);
+         if (ec)
+             return "";
+         std::string name = absolutePath.string();
+         if (name.find('\n') != std::string::npos)
+             return "";
+         return std::to_string(size) + " " + std::to_string((long long) modified.time_since_epoch().count()) + " " + name;
+     };
+
+     // One read-only pass over a mapped file whose header and size are
+     // consistent: the checksum must match and every index must name a point.
+     static bool          CheckContents(const Header *header, size_t size)
+     {
+         const uint32_t *payload = (const uint32_t *) (header+1);
+         size_t nwords = (size - sizeof(Header)) / sizeof(uint32_t);
+         if (HashWords(payload, nwords) != header->checksum)
+             return false;
+         const int32_t *triangles = (const int32_t *) payload + (header->hasNormals ? 6 : 3) * (size_t) header->npoints;
+         uint32_t npoints = (uint32_t) header->npoints;
+         for (size_t i = 0 ; i < 3 * (size_t) header->ntriangles ; i++)
+             if ((uint32_t) triangles[i] >= npoints)
+                 return false;
+         return true;
+     };
+
+     // Builds the vtkPolyData on the arrays in the mapped file.
+     static vtkPolyData  *MakePolyData(const std::shared_ptr<MappedFile> &file, Header *header)
+     {
+         vtkIdType npoints = header->npoints;
+         vtkIdType ntriangles = header->ntriangles;
+         float *points = (float *) (header+1);
+         float *normals = (header->hasNormals ? points + 3*npoints : NULL);
+         int32_t *triangles = (int32_t *) (points + (header->hasNormals ? 6 : 3)*npoints);
+
+         vtkFloatArray *coords = vtkFloatArray::New();
+         coords->SetNumberOfComponents(3);
+         WrapMappedArray(coords, points, 3*npoints, file);
+         vtkPoints *vtk_pts = vtkPoints::New();
+         vtk_pts->SetData(coords);
+         coords->Delete();
+
+         vtkCellArray *tris = vtkCellArray::New();
+#if VTK_MAJOR_VERSION >= 9
+         vtkTypeInt32Array *connectivity = vtkTypeInt32Array::New();
+         WrapMappedArray(connectivity, triangles, 3*ntriangles, file);
+         tris->SetData(3, connectivity);
+         connectivity->Delete();
+#else
+         // Before VTK 9 cells are stored as (3, a, b, c) in vtkIdTypes, which
+         // the file cannot hold for every build, so build them in one pass.
+         vtkIdTypeArray *cells = vtkIdTypeArray::New();
+         vtkIdType *c = cells->WritePointer(0, 4*ntriangles);
+         for (vtkIdType i = 0 ; i < ntriangles ; i++)
+         {
+             c[4*i] = 3;
+             c[4*i+1] = triangles[3*i];
+             c[4*i+2] = triangles[3*i+1];
+             c[4*i+3] = triangles[3*i+2];
+         }
+         tris->SetCells(ntriangles, cells);
+         cells->Delete();
+#endif
+
+         vtkPolyData *pd = vtkPolyData::New();
+         pd->SetPoints(vtk_pts);
+         pd->SetPolys(tris);
+         if (normals != NULL)
+         {
+             vtkFloatArray *vtk_normals = vtkFloatArray::New();
+             vtk_normals->SetName("Normals");
+             vtk_normals->SetNumberOfComponents(3);
+             WrapMappedArray(vtk_normals, normals, 3*npoints, file);
+             pd->GetPointData()->SetNormals(vtk_normals);
+             vtk_normals->Delete();
+         }
+         tris->Delete();
+         vtk_pts->Delete();
+         return pd;
+     };
+
+     // Deletes temporary files left behind by failed writes, then the least
+     // recently used surfaces until the cache fits the budget.
+     inline void          Evict(void)
+     {
+         struct Entry
+         {
+             std::filesystem::path               path;
+             uint64_t                            size;
+             std::filesystem::file_time_type     used;
+         };
+         std::vector<Entry> entries;
+         uint64_t total = 0;
+         std::error_code ec;
+         std::filesystem::file_time_type stale = std::filesystem::file_time_type::clock::now() - std::chrono::hours(1);
+         for (std::filesystem::directory_iterator it(directory, ec), end ; !ec && it != end ; it.increment(ec))
+         {
+             if (it->path().filename().string().find(".tmp") != std::string::npos)
+             {
+                 std::error_code entryError;
+                 if (it->last_write_time(entryError) < stale && !entryError)
+                     std::filesystem::remove(it->path(), entryError);
+                 continue;
+             }
+             if (it->path().extension() != ".surf")
+                 continue;
+             std::error_code entryError;
+             Entry e = { it->path(), (uint64_t) it->file_size(entryError), it->last_write_time(entryError) };
+             if (entryError)
+                 continue;
+             total += e.size;
+             entries.push_back(e);
+         }
+         if (total <= maxBytes)
+             return;
+
+         std::sort(entries.begin(), entries.end(),
+                   [](const Entry &a, const Entry &b) { return a.used < b.used; });
+         for (size_t i = 0 ; i < entries.size() && total > maxBytes ; i++)
+         {
+             if (std::filesystem::remove(entries[i].path, ec))
+             {
+                 total -= entries[i].size;
+                 evictions++;
+             }
+         }
+     };
+};
+
+#endif
@@ -0,0 +1,430 @@
+//This header file contains the marching cubes case table. Instead of being typed in by hand, the table
+//is generated at compile time from the topology of the cube and checked with static_asserts, so a
+//bad case is a compile error rather than a crack in the surface.
+//
+//The cube uses the same numbering as Isosurface.cxx. Vertex v sits at x = v&1, y = (v>>2)&1 and
+//z = (v>>1)&1 of the cell, and bit v of the case ID is set when F at vertex v is <= the isovalue
+//("inside"). The edges are
+//
+//     0: 0-1   1: 1-3   2: 2-3   3: 0-2      (y = 0)
+//     4: 4-5   5: 5-7   6: 6-7   7: 4-6      (y = 1)
+//     8: 0-4   9: 1-5  10: 2-6  11: 3-7      (along y)
+//
+//Every triangle is wound so that its normal points from the inside vertices toward the outside ones,
+//i.e. in the direction F increases.
+#ifndef TRICASE_H
+#define TRICASE_H
+
+#include <stdint.h>
+
+
+namespace TriCaseDetail
+{
+    // ************************************************************************
+    //  Cube topology
+    //
+    //  edgeVertices: the two vertices at the ends of each edge.
+    //  faceVertices: the four vertices of each face, counterclockwise when the
+    //                face is seen from outside the cell. The faces are x = 0,
+    //                x = 1, y = 0, y = 1, z = 0 and z = 1.
+    //
+    // ************************************************************************
+
+    struct Topology
+    {
+        int edgeVertices[12][2];
+        int faceVertices[6][4];
+    };
+
+    constexpr Topology topology = {
+        { { 0, 1 }, { 1, 3 }, { 2, 3 }, { 0, 2 },
+          { 4, 5 }, { 5, 7 }, { 6, 7 }, { 4, 6 },
+          { 0, 4 }, { 1, 5 }, { 2, 6 }, { 3, 7 } },
+        { { 0, 2, 6, 4 }, { 1, 5, 7, 3 }, { 0, 1, 3, 2 },
+          { 4, 6, 7, 5 }, { 0, 4, 5, 1 }, { 2, 3, 7, 6 } }
+    };
+
+    constexpr int MaxTrianglesPerCase = 5;
+
+    constexpr int VertexCoord(int v, int axis)
+    {
+        return axis == 0 ? (v & 1) : axis == 1 ? ((v >> 2) & 1) : ((v >> 1) & 1);
+    }
+
+    constexpr int EdgeBetween(int v0, int v1)
+    {
+        for (int e = 0 ; e < 12 ; e++)
+            if ((topology.edgeVertices[e][0] == v0 && topology.edgeVertices[e][1] == v1) ||
+                (topology.edgeVertices[e][0] == v1 && topology.edgeVertices[e][1] == v0))
+                return e;
+        return -1;
+    }
+
+    constexpr bool Inside(int caseID, int v)
+    {
+        return ((caseID >> v) & 1) != 0;
+    }
+
+    // Twice the midpoint of an edge, so positions stay integers.
+    constexpr int EdgeMidpoint2(int e, int axis)
+    {
+        return VertexCoord(topology.edgeVertices[e][0], axis) + VertexCoord(topology.edgeVertices[e][1], axis);
+    }
+
+    constexpr bool OnFace(int e, int f)
+    {
+        int n = 0;
+        for (int k = 0 ; k < 4 ; k++)
+            if (topology.faceVertices[f][k] == topology.edgeVertices[e][0] ||
+                topology.faceVertices[f][k] == topology.edgeVertices[e][1])
+                n++;
+        return n == 2;
+    }
+
+    constexpr bool SameFace(int a, int b)
+    {
+        for (int f = 0 ; f < 6 ; f++)
+            if (OnFace(a, f) && OnFace(b, f))
+                return true;
+        return false;
+    }
+
+    // The triangles of one case, as edge IDs.
+    struct Case
+    {
+        int ntriangles;
+        int edges[3*MaxTrianglesPerCase];
+    };
+
+    // ************************************************************************
+    //  Function: GenerateCase
+    //
+    //  Walking each face counterclockwise from outside, every run of inside
+    //  vertices is cut off by a segment from the edge where the walk leaves
+    //  the run to the edge where it entered it. On a face with two diagonal
+    //  inside vertices this keeps them apart, and since the segments depend
+    //  only on the four values on the face, the cell on the other side of the
+    //  face produces the same segments in the opposite direction. Each
+    //  crossed edge then starts exactly one segment, so the segments chain
+    //  into closed loops, which are triangulated as fans.
+    //
+    //  The apex of each fan is picked so that no diagonal of the fan joins two
+    //  edges on the same face. Such a diagonal would lie in the face, and the
+    //  neighboring cell can make the same one, leaving it shared by four
+    //  triangles.
+    //
+    // ************************************************************************
+
+    constexpr Case GenerateCase(int caseID)
+    {
+        int next[12] = { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 };
+        for (int f = 0 ; f < 6 ; f++)
+        {
+            const int *fv = topology.faceVertices[f];
+            for (int k = 0 ; k < 4 ; k++)
+            {
+                if (!Inside(caseID, fv[k]) || Inside(caseID, fv[(k+1)%4]))
+                    continue;
+                int j = k;
+                while (Inside(caseID, fv[(j+3)%4]))
+                    j = (j+3)%4;
+                next[EdgeBetween(fv[k], fv[(k+1)%4])] = EdgeBetween(fv[(j+3)%4], fv[j]);
+            }
+        }
+
+        Case c = { 0, { 0 } };
+        bool used[12] = { false, false, false, false, false, false,
+                          false, false, false, false, false, false };
+        for (int e = 0 ; e < 12 ; e++)
+        {
+            if (next[e] < 0 || used[e])
+                continue;
+            int loop[12] = { 0 };
+            int n = 0;
+            for (int l = e ; !used[l] ; l = next[l])
+            {
+                used[l] = true;
+                loop[n++] = l;
+            }
+            int apex = 0;
+            for (int a = n-1 ; a >= 0 ; a--)
+            {
+                bool inFace = false;
+                for (int t = 2 ; t+1 < n ; t++)
+                    inFace = inFace || SameFace(loop[a], loop[(a+t)%n]);
+                if (!inFace)
+                    apex = a;
+            }
+            for (int t = 1 ; t+1 < n ; t++)
+            {
+                c.edges[3*c.ntriangles+0] = loop[apex];
+                c.edges[3*c.ntriangles+1] = loop[(apex+t+1)%n];
+                c.edges[3*c.ntriangles+2] = loop[(apex+t)%n];
+                c.ntriangles++;
+            }
+        }
+        return c;
+    }
+
+    struct Cases
+    {
+        Case c[256];
+    };
+
+    constexpr Cases GenerateCases()
+    {
+        Cases cases = { };
+        for (int caseID = 0 ; caseID < 256 ; caseID++)
+            cases.c[caseID] = GenerateCase(caseID);
+        return cases;
+    }
+
+    constexpr Cases cases = GenerateCases();
+
+    constexpr int CountEdges()
+    {
+        int n = 0;
+        for (int caseID = 0 ; caseID < 256 ; caseID++)
+            n += 3*cases.c[caseID].ntriangles;
+        return n;
+    }
+
+    constexpr int NumEdges = CountEdges();
+
+    // ************************************************************************
+    //  Struct: PackedTable
+    //
+    //  All cases back to back: the triangles of case c are the
+    //  3*triangleCount[c] edge IDs starting at edges[firstEdge[c]].
+    //
+    // ************************************************************************
+
+    struct PackedTable
+    {
+        uint8_t   triangleCount[256];
+        uint16_t  firstEdge[256];
+        uint8_t   edges[NumEdges];
+    };
+
+    constexpr PackedTable Pack()
+    {
+        PackedTable table = { };
+        int n = 0;
+        for (int caseID = 0 ; caseID < 256 ; caseID++)
+        {
+            table.triangleCount[caseID] = (uint8_t) cases.c[caseID].ntriangles;
+            table.firstEdge[caseID] = (uint16_t) n;
+            for (int i = 0 ; i < 3*cases.c[caseID].ntriangles ; i++)
+                table.edges[n++] = (uint8_t) cases.c[caseID].edges[i];
+        }
+        return table;
+    }
+
+    // ************************************************************************
+    //  Validation
+    //
+    //  Watertight: inside a cell, every edge of a triangle is shared with
+    //  another triangle of the case, traversed the other way. The remaining
+    //  (boundary) edges lie on a face of the cell, and the cell next to that
+    //  face, for any values on its far side, has the same boundary edges in
+    //  the opposite direction.
+    //
+    //  No diagonals in a face: the triangles of a case only meet along lines
+    //  through the cell, never along a line joining two edges of one face.
+    //
+    //  Oriented: no triangle's normal points away from the outside vertices of
+    //  the edges it cuts (with the vertices at the edge midpoints, a fan
+    //  triangle of a non-planar loop can be edge-on), and together they point
+    //  toward them.
+    //
+    // ************************************************************************
+
+    constexpr int CountDirected(const Case &c, int a, int b)
+    {
+        int n = 0;
+        for (int t = 0 ; t < c.ntriangles ; t++)
+            for (int k = 0 ; k < 3 ; k++)
+                if (c.edges[3*t+k] == a && c.edges[3*t+(k+1)%3] == b)
+                    n++;
+        return n;
+    }
+
+    // The vertex of the neighboring cell that coincides with vertex v, when
+    // the neighbor is across a face normal to the given axis.
+    constexpr int AcrossFace(int v, int axis)
+    {
+        return v ^ (axis == 0 ? 1 : axis == 1 ? 4 : 2);
+    }
+
+    constexpr int EdgeAcrossFace(int e, int axis)
+    {
+        return EdgeBetween(AcrossFace(topology.edgeVertices[e][0], axis),
+                           AcrossFace(topology.edgeVertices[e][1], axis));
+    }
+
+    constexpr bool IsWatertight(int caseID)
+    {
+        const Case &c = cases.c[caseID];
+        if (c.ntriangles > MaxTrianglesPerCase)
+            return false;
+        for (int t = 0 ; t < c.ntriangles ; t++)
+        {
+            for (int k = 0 ; k < 3 ; k++)
+            {
+                int a = c.edges[3*t+k], b = c.edges[3*t+(k+1)%3];
+                if (a == b || CountDirected(c, a, b) != 1)
+                    return false;
+                if (CountDirected(c, b, a) == 1)
+                    continue;
+
+                // A boundary edge: it has to lie on a face, and the cell
+                // across that face has to run it the other way.
+                bool onFace = false;
+                for (int axis = 0 ; axis < 3 ; axis++)
+                {
+                    for (int side = 0 ; side < 2 ; side++)
+                    {
+                        int f = 2*axis+side;
+                        if (!OnFace(a, f) || !OnFace(b, f))
+                            continue;
+                        onFace = true;
+
+                        // Try every combination of values on the far side
+                        // of the neighbor.
+                        int shared = 0, far[4] = { 0, 0, 0, 0 }, nfar = 0;
+                        for (int v = 0 ; v < 8 ; v++)
+                        {
+                            if (VertexCoord(v, axis) != side)
+                                continue;
+                            far[nfar++] = v;
+                            if (Inside(caseID, v))
+                                shared |= 1 << AcrossFace(v, axis);
+                        }
+                        for (int m = 0 ; m < 16 ; m++)
+                        {
+                            int neighbor = shared;
+                            for (int k = 0 ; k < 4 ; k++)
+                                if ((m >> k) & 1)
+                                    neighbor |= 1 << far[k];
+                            if (CountDirected(cases.c[neighbor], EdgeAcrossFace(b, axis), EdgeAcrossFace(a, axis)) != 1)
+                                return false;
+                        }
+                    }
+                }
+                if (!onFace)
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    constexpr bool HasNoFaceDiagonals(int caseID)
+    {
+        const Case &c = cases.c[caseID];
+        for (int t = 0 ; t < c.ntriangles ; t++)
+            for (int k = 0 ; k < 3 ; k++)
+            {
+                int a = c.edges[3*t+k], b = c.edges[3*t+(k+1)%3];
+                if (CountDirected(c, b, a) > 0 && SameFace(a, b))
+                    return false;
+            }
+        return true;
+    }
+
+    constexpr bool IsOriented(int caseID)
+    {
+        const Case &c = cases.c[caseID];
+        int total = 0;
+        for (int t = 0 ; t < c.ntriangles ; t++)
+        {
+            int p[3][3] = { { 0 } };
+            int out[3] = { 0, 0, 0 };
+            for (int k = 0 ; k < 3 ; k++)
+            {
+                int e = c.edges[3*t+k];
+                int v0 = topology.edgeVertices[e][0], v1 = topology.edgeVertices[e][1];
+                int vin = Inside(caseID, v0) ? v0 : v1;
+                int vout = Inside(caseID, v0) ? v1 : v0;
+                if (Inside(caseID, vout) || !Inside(caseID, vin))
+                    return false;
+                for (int axis = 0 ; axis < 3 ; axis++)
+                {
+                    p[k][axis] = EdgeMidpoint2(e, axis);
+                    out[axis] += VertexCoord(vout, axis) - VertexCoord(vin, axis);
+                }
+            }
+            int u[3] = { p[1][0]-p[0][0], p[1][1]-p[0][1], p[1][2]-p[0][2] };
+            int w[3] = { p[2][0]-p[0][0], p[2][1]-p[0][1], p[2][2]-p[0][2] };
+            int n[3] = { u[1]*w[2]-u[2]*w[1], u[2]*w[0]-u[0]*w[2], u[0]*w[1]-u[1]*w[0] };
+            int dot = n[0]*out[0] + n[1]*out[1] + n[2]*out[2];
+            if (dot < 0)
+                return false;
+            total += dot;
+        }
+        return c.ntriangles == 0 || total > 0;
+    }
+
+    constexpr bool FacesAreCounterclockwise()
+    {
+        for (int f = 0 ; f < 6 ; f++)
+        {
+            const int *fv = topology.faceVertices[f];
+            int u[3] = { 0, 0, 0 }, w[3] = { 0, 0, 0 }, outward[3] = { 0, 0, 0 };
+            for (int axis = 0 ; axis < 3 ; axis++)
+            {
+                u[axis] = VertexCoord(fv[1], axis) - VertexCoord(fv[0], axis);
+                w[axis] = VertexCoord(fv[2], axis) - VertexCoord(fv[1], axis);
+            }
+            outward[f/2] = (f % 2) ? 1 : -1;
+            int n[3] = { u[1]*w[2]-u[2]*w[1], u[2]*w[0]-u[0]*w[2], u[0]*w[1]-u[1]*w[0] };
+            if (n[0]*outward[0] + n[1]*outward[1] + n[2]*outward[2] <= 0)
+                return false;
+            for (int k = 0 ; k < 4 ; k++)
+                if (VertexCoord(fv[k], f/2) != f % 2 || EdgeBetween(fv[k], fv[(k+1)%4]) < 0)
+                    return false;
+        }
+        return true;
+    }
+
+    constexpr bool ValidateCases()
+    {
+        if (cases.c[0].ntriangles != 0 || cases.c[255].ntriangles != 0)
+            return false;
+        for (int caseID = 0 ; caseID < 256 ; caseID++)
+            if (!IsWatertight(caseID) || !IsOriented(caseID))
+                return false;
+        return true;
+    }
+
+    static_assert(FacesAreCounterclockwise(), "cube faces must be listed counterclockwise from outside");
+    static_assert(ValidateCases(), "marching cubes case table is not watertight and consistently oriented");
+
+    constexpr bool ValidateFaceDiagonals()
+    {
+        for (int caseID = 0 ; caseID < 256 ; caseID++)
+            if (!HasNoFaceDiagonals(caseID))
+                return false;
+        return true;
+    }
+
+    static_assert(ValidateFaceDiagonals(), "marching cubes case table has a triangle edge lying in a cell face");
+}
+
+
+// ****************************************************************************
+//  triCase
+//
+//  The generated table. For a cell with case ID c, there are
+//  triCase.triangleCount[c] triangles, whose edge IDs are the
+//  3*triCase.triangleCount[c] entries starting at
+//  triCase.edges + triCase.firstEdge[c].
+//
+// ****************************************************************************
+
+constexpr TriCaseDetail::PackedTable triCase = TriCaseDetail::Pack();
+
+// The two cell vertices at the ends of each edge, in the order the edge is
+// interpolated.
+constexpr const int (&triCaseEdgeVertices)[12][2] = TriCaseDetail::topology.edgeVertices;
+
+#endif
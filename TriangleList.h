@@ -1,5 +1,8 @@
 //This header file contains a TriangleList class with simple inline functions to add each triangle from
 //the triCase array into the list to be rendered as an isosurface.
+#ifndef TRIANGLELIST_H
+#define TRIANGLELIST_H
+
 #include <vtkPolyData.h>
 #include <vtkPointData.h>
 #include <vtkPolyDataReader.h>
@@ -12,56 +15,159 @@
 #include <vtkContourFilter.h>
 #include <vtkRectilinearGrid.h>
 
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <new>
+#include <vector>
+
+
+// ****************************************************************************
+//  Class: TriangleList
+//
+//  Purpose:
+//      The triangles of an isosurface, nine floats per triangle for the
+//      points and optionally nine for the normals. The list grows as needed
+//      up to MaxTriangles, so that the index of every corner still fits an
+//      int; growing past that, or running out of memory, throws
+//      std::bad_alloc and leaves the list as it was.
+//
+// ****************************************************************************
 
 class TriangleList
 {
    public:
-                   TriangleList() { maxTriangles = 1000000; triangleIdx = 0; pts = new float[4*maxTriangles]; };
-     virtual      ~TriangleList() { delete [] pts; };
+     static const int MaxTriangles = INT_MAX / 3;
+
+                   TriangleList() { maxTriangles = 1000000; triangleIdx = 0; pts = new float[9*maxTriangles]; normals = NULL; hasNormals = false; };
+     virtual      ~TriangleList() { delete [] pts; delete [] normals; };
+
+     inline void          Reset(void) { triangleIdx = 0; hasNormals = false; };
 
      inline void          AddTriangle(float X1, float Y1, float Z1, float X2, float Y2, float Z2, float X3, float Y3, float Z3)
      {
          if (triangleIdx >= maxTriangles)
+             Grow(triangleIdx+(int64_t)1);
+
+         float *p = pts + 9*(size_t)triangleIdx;
+         p[0] = X1;
+         p[1] = Y1;
+         p[2] = Z1;
+         p[3] = X2;
+         p[4] = Y2;
+         p[5] = Z2;
+         p[6] = X3;
+         p[7] = Y3;
+         p[8] = Z3;
+         triangleIdx++;
+     };
+
+     // Adds a triangle along with a normal for each of its vertices. Either all
+     // triangles in the list have normals or none of them do.
+     inline void          AddTriangle(const float *P1, const float *P2, const float *P3, const float *N1, const float *N2, const float *N3)
+     {
+         if (triangleIdx >= maxTriangles)
+             Grow(triangleIdx+(int64_t)1);
+         if (normals == NULL)
+             normals = new float[9*(size_t)maxTriangles];
+         hasNormals = true;
+
+         float *n = normals + 9*(size_t)triangleIdx;
+         for (int i = 0 ; i < 3 ; i++)
          {
-             cerr << "No room for more triangles!" << endl;
-             return;
+             n[0+i] = N1[i];
+             n[3+i] = N2[i];
+             n[6+i] = N3[i];
          }
+         AddTriangle(P1[0], P1[1], P1[2], P2[0], P2[1], P2[2], P3[0], P3[1], P3[2]);
+     };
 
-         pts[9*triangleIdx+0] = X1;
-         pts[9*triangleIdx+1] = Y1;
-         pts[9*triangleIdx+2] = Z1;
-         pts[9*triangleIdx+3] = X2;
-         pts[9*triangleIdx+4] = Y2;
-         pts[9*triangleIdx+5] = Z2;
-         pts[9*triangleIdx+6] = X3;
-         pts[9*triangleIdx+7] = Y3;
-         pts[9*triangleIdx+8] = Z3;
-         triangleIdx++;
+     // Makes room for ntriangles more triangles, growing the list if needed,
+     // and returns the index of the first of them. The caller fills them in
+     // through GetTrianglePoints()/GetTriangleNormals(), which several
+     // threads can do at once as long as they write different triangles.
+     inline int           AddTriangles(int64_t ntriangles, bool withNormals)
+     {
+         if (triangleIdx + ntriangles > maxTriangles)
+             Grow(triangleIdx + ntriangles);
+         if (withNormals && normals == NULL)
+             normals = new float[9*(size_t)maxTriangles];
+         hasNormals = withNormals;
+
+         int first = triangleIdx;
+         triangleIdx += (int) ntriangles;
+         return first;
+     };
+     inline float        *GetTrianglePoints(int t) { return pts + 9*(size_t)t; };
+     inline float        *GetTriangleNormals(int t) { return normals + 9*(size_t)t; };
+
+     // Numbers the distinct points of triangles laid out like the list's own,
+     // in the order they are first used: ids gets the number of every corner
+     // and firstUse the first corner of every point. Points are the same if
+     // their coordinates are, which is enough for the extraction kernels: the
+     // cells on either side of an edge compute its point the same way.
+     static void          Weld(const float *pts, int ntriangles, std::vector<int> &ids, std::vector<int> &firstUse)
+     {
+         size_t size = 1;
+         while (size < 6*(size_t)ntriangles)
+             size <<= 1;
+         std::vector<int> table(size, -1);
+         ids.resize(3*(size_t)ntriangles);
+         firstUse.clear();
+         for (size_t k = 0 ; k < 3*(size_t)ntriangles ; k++)
+         {
+             const float *pt = pts + 3*k;
+             uint32_t bits[3];
+             memcpy(bits, pt, sizeof(bits));
+             size_t slot = (bits[0]*0x9E3779B1u ^ bits[1]*0x85EBCA77u ^ bits[2]*0xC2B2AE3Du) & (size-1);
+             while (table[slot] >= 0 && memcmp(pts + 3*(size_t)firstUse[table[slot]], pt, 3*sizeof(float)) != 0)
+                 slot = (slot + 1) & (size-1);
+             if (table[slot] < 0)
+             {
+                 table[slot] = (int) firstUse.size();
+                 firstUse.push_back((int) k);
+             }
+             ids[k] = table[slot];
+         }
      };
 
+     inline int           GetNumberOfTriangles(void) const { return triangleIdx; };
+     inline const float  *GetPoints(void) const { return pts; };
+     inline const float  *GetNormals(void) const { return (hasNormals ? normals : NULL); };
+
      inline vtkPolyData  *MakePolyData(void)
      {
-         int ntriangles = triangleIdx;
-         int numPoints = 3*(ntriangles);
+         return MakePolyData(pts, (hasNormals ? normals : NULL), triangleIdx);
+     };
+
+     // Builds a vtkPolyData from triangles laid out like the list's own: nine
+     // floats per triangle for the points and, if normals is not NULL, nine
+     // for the normals.
+     static vtkPolyData  *MakePolyData(const float *pts, const float *normals, int ntriangles)
+     {
+         vtkIdType numPoints = 3*(vtkIdType)ntriangles;
          vtkPoints *vtk_pts = vtkPoints::New();
          vtk_pts->SetNumberOfPoints(numPoints);
-         int ptIdx = 0;
+         vtkIdType ptIdx = 0;
          vtkCellArray *tris = vtkCellArray::New();
          tris->EstimateSize(numPoints,3);
          for (int i = 0 ; i < ntriangles ; i++)
          {
+             const float *p = pts + 9*(size_t)i;
              double pt[3];
-             pt[0] = pts[9*i+0];
-             pt[1] = pts[9*i+1];
-             pt[2] = pts[9*i+2];
+             pt[0] = p[0];
+             pt[1] = p[1];
+             pt[2] = p[2];
              vtk_pts->SetPoint(ptIdx, pt);
-             pt[0] = pts[9*i+3];
-             pt[1] = pts[9*i+4];
-             pt[2] = pts[9*i+5];
+             pt[0] = p[3];
+             pt[1] = p[4];
+             pt[2] = p[5];
              vtk_pts->SetPoint(ptIdx+1, pt);
-             pt[0] = pts[9*i+6];
-             pt[1] = pts[9*i+7];
-             pt[2] = pts[9*i+8];
+             pt[0] = p[6];
+             pt[1] = p[7];
+             pt[2] = p[8];
              vtk_pts->SetPoint(ptIdx+2, pt);
              vtkIdType ids[3] = { ptIdx, ptIdx+1, ptIdx+2 };
              tris->InsertNextCell(3, ids);
@@ -71,6 +177,16 @@ class TriangleList
          vtkPolyData *pd = vtkPolyData::New();
          pd->SetPoints(vtk_pts);
          pd->SetPolys(tris);
+         if (normals != NULL)
+         {
+             vtkFloatArray *vtk_normals = vtkFloatArray::New();
+             vtk_normals->SetName("Normals");
+             vtk_normals->SetNumberOfComponents(3);
+             vtk_normals->SetNumberOfTuples(numPoints);
+             memcpy(vtk_normals->GetPointer(0), normals, 3*(size_t)numPoints*sizeof(float));
+             pd->GetPointData()->SetNormals(vtk_normals);
+             vtk_normals->Delete();
+         }
          tris->Delete();
          vtk_pts->Delete();
 
@@ -78,9 +194,45 @@ class TriangleList
      };
 
    protected:
+     // Makes room for at least needed triangles, at least doubling the list
+     // so that adding triangles one at a time stays linear. Both buffers are
+     // allocated before either is replaced, so a failure changes nothing.
+     inline void          Grow(int64_t needed)
+     {
+         if (needed > MaxTriangles)
+         {
+             cerr << "A surface of " << needed << " triangles is over the limit of " << MaxTriangles << endl;
+             throw std::bad_alloc();
+         }
+         int newMax = (int) std::min(std::max(needed, 2*(int64_t)maxTriangles), (int64_t)MaxTriangles);
+         float *newPts = new float[9*(size_t)newMax];
+         float *newNormals = NULL;
+         if (normals != NULL)
+         {
+             try
+             {
+                 newNormals = new float[9*(size_t)newMax];
+             }
+             catch (...)
+             {
+                 delete [] newPts;
+                 throw;
+             }
+             memcpy(newNormals, normals, 9*(size_t)triangleIdx*sizeof(float));
+             delete [] normals;
+             normals = newNormals;
+         }
+         memcpy(newPts, pts, 9*(size_t)triangleIdx*sizeof(float));
+         delete [] pts;
+         pts = newPts;
+         maxTriangles = newMax;
+     };
+
      float        *pts;
+     float        *normals;
+     bool          hasNormals;
      int           maxTriangles;
      int           triangleIdx;
 };
 
-
+#endif